@@ -1,19 +1,33 @@
 #include "AESHelper.h"
 #include <vector>
-#include <iostream>
 #include <iterator>
-#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <memory>
 #include <stdexcept>
 #include "Base64Helper.h"
 #include "PBKDF2Helper.h"
 #include "HashHelper.h"
+#include "Log.h"
+#include "BlockIVGenerator.h"
+#include "BoundedQueue.h"
+#include "BufferPool.h"
+#include "FileBlockDecryptor.h"
+#include "MappedFile.h"
+#include "OutputFile.h"
+#include "ProgressReporter.h"
+#include "ThreadPool.h"
+#include "RunStatistics.h"
 #include "aes.h"
 #include "modes.h"
 #include "files.h"
 
 bool AESHelper::DecryptDataPBKDF2(const std::string& data, const std::string& pbkdf2Password, const std::string& pbkdf2Salt, unsigned int pbkdf2Iterations, std::string& decryptedData)
 {
-	std::cout << "AES decryption of data started" << std::endl;
+	LOG_DEBUG("AES decryption of data started");
 
 	if (pbkdf2Password.length() > 0 && pbkdf2Salt.length() > 0 && pbkdf2Iterations > 0)
 	{
@@ -52,7 +66,7 @@ bool AESHelper::DecryptDataPBKDF2(const std::string& data, const std::string& pb
 
 		AESHelper::DecryptData(privateKeyBytes, cryptoKey, IVec, decryptedData, false);
 
-		std::cout << "AES decryption finished" << std::endl;
+		LOG_DEBUG("AES decryption finished");
 		return true;
 	}
 	else
@@ -64,129 +78,115 @@ bool AESHelper::DecryptDataPBKDF2(const std::string& data, const std::string& pb
 bool AESHelper::DecryptFile(
 	const std::string& encryptedFilePath, const std::vector<byte>& fileCryptoKey,
 	const std::string& baseIVec, unsigned int blockSize, unsigned int offset,
-	unsigned int padding, std::vector<byte>& decryptedFileBytes)
+	unsigned int padding, std::ostream& output, unsigned int threadCount /* = 1*/,
+	unsigned int bufferedBlocks /* = DefaultBufferedBlocks*/)
 {
-	std::cout << "AES decryption of file '" << encryptedFilePath << "' started" << std::endl;
-
-	if (fileCryptoKey.size() > 0 && blockSize > 0)
+	// open the encrypted file, ...
+	std::ifstream ifs(encryptedFilePath, std::ios::binary | std::ios::ate);
+	if (!ifs.good())
 	{
-		// open the encrypted file, ...
-		std::ifstream ifs(encryptedFilePath, std::ios::binary | std::ios::ate);
-		if (!ifs.good())
-		{
-			std::string errorMsg("Encrypted file (" + encryptedFilePath + ") can't be opened (make sure the provided path is correct, the file exists and you have the right to open the file)");
-			throw std::runtime_error(errorMsg.c_str());
-		}
-
-		// ... get the size ...
-		std::streamoff pos = ifs.tellg();
-		ifs.seekg(0, std::ios::beg);
-
-		// ... and copy it into a byte vector to work with the data
-		std::vector<char> fileBytes(static_cast<size_t>(pos));
-		ifs.read(&fileBytes[0], pos);
+		std::string errorMsg("Encrypted file (" + encryptedFilePath + ") can't be opened (make sure the provided path is correct, the file exists and you have the right to open the file)");
+		throw std::runtime_error(errorMsg.c_str());
+	}
 
-		// IVec in file header is base 64 encoded
-		std::vector<byte> decodedFileIV;
-		Base64Helper::Decode(baseIVec, decodedFileIV);
+	// ... get the size and skip the header
+	size_t fileSize = static_cast<size_t>(ifs.tellg());
+	ifs.seekg(offset, std::ios::beg);
 
-		// create result vector and reserve enough space
-		// to fit the complete decrypted file
-		decryptedFileBytes.clear();
-		decryptedFileBytes.reserve(fileBytes.size());
-		unsigned long blockNo = 0;
-
-		// report initial status
-		size_t fileSize = fileBytes.size();
-		std::string fileSizeStr = std::to_string(fileSize);
-		auto fileSizeFivePer = static_cast<size_t>(std::floor(fileSize * 0.05));
-		std::string byteProgress = " (0 / " + fileSizeStr + " bytes)";
-		std::cout << "Progress: [" << std::setfill(' ') << std::setw(21) << "]" << std::left << std::setw(79) << byteProgress << std::right;
-
-		// decrypt each block seperately with its own initialization vector
-		for (size_t byteNo = offset, nextStatusThreshold = offset, currentStep = 0; byteNo < fileSize; byteNo += blockSize, ++blockNo)
+	// the chunks are read one after the other into the buffer and decrypted in place there
+	AESHelper::DecryptFileChunks(encryptedFilePath, fileSize, [&](size_t /*pos*/, size_t len, byte *buffer) -> const byte *
+	{
+		StageTimer timer(Stage::Read);
+		ifs.read(reinterpret_cast<char *>(buffer), len);
+		if (static_cast<size_t>(ifs.gcount()) != len)
 		{
-			auto blockIVec = AESHelper::ComputeBlockIVec(decodedFileIV, blockNo, fileCryptoKey);
-
-			// get the input data for the current block (the last block may be shorter than [blockSize] bytes)
-			auto iterEnd = (byteNo + blockSize >= fileSize) ? fileBytes.end() : fileBytes.begin() + byteNo + blockSize;
-			std::vector<byte> blockInput(fileBytes.begin() + byteNo, iterEnd);
-
-			// use PKCS7 padding for the last block if a cipher padding size greater than 0 was specified in file header
-			auto currentPadding = (iterEnd == fileBytes.end() && padding > 0) ? CryptoPP::StreamTransformationFilter::PKCS_PADDING : CryptoPP::StreamTransformationFilter::NO_PADDING;
-
-			// get the decrypted data for this block ...
-			std::string decryptedBlockBytes;
-			AESHelper::DecryptData(blockInput, fileCryptoKey, blockIVec, decryptedBlockBytes, true, currentPadding);
-
-			// ... and append it to the data of previous blocks
-			decryptedFileBytes.insert(decryptedFileBytes.end(), decryptedBlockBytes.begin(), decryptedBlockBytes.end());
-
-			// report intermediate status every 5%
-			if (byteNo > nextStatusThreshold)
-			{
-				int steps = byteNo / nextStatusThreshold;
-				nextStatusThreshold += fileSizeFivePer * steps;
-
-				currentStep += steps;
-				byteProgress = " (" + std::to_string(byteNo) + " / " + fileSizeStr + " bytes)";
-				std::cout << std::setfill('\b') << std::setw(100) << "" << std::setfill('#') << std::setw(currentStep) << "" << std::setfill(' ') << std::setw(21 - currentStep)
-					<< "]" << std::left << std::setw(79) << byteProgress << std::right;
-			}
+			std::string errorMsg("Encrypted file (" + encryptedFilePath + ") could not be read completely");
+			throw std::runtime_error(errorMsg.c_str());
 		}
+		return buffer;
+	}, fileCryptoKey, baseIVec, blockSize, offset, padding, output, threadCount, bufferedBlocks);
+	return true;
+}
 
-		// newline and buffer flush after status report
-		byteProgress = " (" + fileSizeStr + " / " + fileSizeStr + " bytes)";
-		std::cout << std::setfill('\b') << std::setw(100) << "" << std::setfill('#') << std::setw(21) << "]" << std::setfill(' ')
-			<< std::left << std::setw(79) << byteProgress << std::right << std::endl;
-		
-		std::cout << "AES decryption of file finished" << std::endl;
-		return true;
-	}
-	else
+bool AESHelper::DecryptFile(
+	const MappedFile& encryptedFile, const std::vector<byte>& fileCryptoKey,
+	const std::string& baseIVec, unsigned int blockSize, unsigned int offset,
+	unsigned int padding, std::ostream& output, unsigned int threadCount /* = 1*/,
+	unsigned int bufferedBlocks /* = DefaultBufferedBlocks*/)
+{
+	// the ciphertext is decrypted straight out of the mapped pages into the buffer,
+	// which is read front to back exactly once
+	encryptedFile.AdviseSequential(offset, encryptedFile.GetSize());
+	AESHelper::DecryptFileChunks(encryptedFile.GetFilePath(), encryptedFile.GetSize(), [&](size_t pos, size_t /*len*/, byte * /*buffer*/) -> const byte *
 	{
-		throw std::runtime_error("Crypto key for file can't be empty and block size must be bigger than zero");
-	}
+		return encryptedFile.GetData() + pos;
+	}, fileCryptoKey, baseIVec, blockSize, offset, padding, output, threadCount, bufferedBlocks);
+	return true;
 }
 
-// from https://github.com/vgough/encfs/blob/559c30d01ed0a3d19258b12f15eae8785accc60f/encfs/SSL_Cipher.cpp#L626
-/*private*/ std::vector<byte> AESHelper::ComputeBlockIVec(std::vector<byte> IVec, unsigned long seed, std::vector<byte> key)
+bool AESHelper::DecryptFile(
+	const MappedFile& encryptedFile, const std::vector<byte>& fileCryptoKey,
+	const std::string& baseIVec, unsigned int blockSize, unsigned int offset,
+	unsigned int padding, OutputFile& output, unsigned int threadCount /* = 1*/,
+	unsigned int bufferedBlocks /* = DefaultBufferedBlocks*/)
 {
-	if (IVec.size() > 0 && key.size() > 0)
+	size_t bodySize = encryptedFile.GetSize() > offset ? encryptedFile.GetSize() - offset : 0;
+	if (output.GetSize() < bodySize)
 	{
-		std::vector<byte> md(8);
-		for (int i = 0; i < 8; ++i)
-		{
-			md.at(i) = static_cast<byte>(seed & 0xff);
-			seed >>= 8;
-		}
-
-		std::vector<byte> data(IVec.size() + md.size());
-		for (size_t i = 0; i < IVec.size(); ++i)
-		{
-			data.at(i) = IVec.at(i);
-		}
-
-		for (size_t i = 0; i < md.size(); ++i)
-		{
-			data.at(i + IVec.size()) = md.at(i);
-		}
-
-		std::vector<byte> buffer;
-		HashHelper::ComputeSHA256HMAC(data, key, buffer, true);
+		throw std::runtime_error("Decrypted file is smaller than the encrypted file data");
+	}
 
-		std::vector<byte> result(IVec.size());
-		for (size_t i = 0; i < IVec.size(); ++i)
+	if (fileCryptoKey.empty() || blockSize == 0 || threadCount == 0 || bufferedBlocks == 0)
+	{
+		throw std::runtime_error("Crypto key for file can't be empty and block size, thread count and buffered block count must be bigger than zero");
+	}
+	LOG_DEBUG("AES decryption of file '" << encryptedFile.GetFilePath() << "' started");
+
+	std::vector<byte> decodedFileIV;
+	Base64Helper::Decode(baseIVec, decodedFileIV);
+	BlockIVGenerator blockIVGenerator(decodedFileIV, fileCryptoKey);
+
+	// the blocks are decrypted from the mapped input straight into the mapped output, so
+	// there is neither a buffer in between nor anything to wait for but the page faults; the
+	// body is split into a few ranges per thread, so threads which are done early take over
+	// the rest, and each range is decrypted in chunks of [bufferedBlocks] blocks with a
+	// decryptor of its own, so the AES key schedule is only computed once per range
+	encryptedFile.AdviseSequential(offset, encryptedFile.GetSize());
+	ThreadPool threadPool(threadCount);
+	size_t blockCount = (bodySize + blockSize - 1) / blockSize;
+	size_t rangeTarget = static_cast<size_t>(threadPool.GetThreadCount()) * 4;
+	size_t blocksPerRange = std::max<size_t>(bufferedBlocks, (blockCount + rangeTarget - 1) / rangeTarget);
+	size_t rangeCount = (blockCount + blocksPerRange - 1) / blocksPerRange;
+	std::vector<size_t> rangePlaintextLens(rangeCount);
+	threadPool.ParallelFor(rangeCount, [&](size_t rangeNo)
+	{
+		FileBlockDecryptor blockDecryptor(fileCryptoKey, blockIVGenerator);
+		size_t rangeEndBlockNo = std::min(blockCount, (rangeNo + 1) * blocksPerRange);
+		for (size_t blockNo = rangeNo * blocksPerRange; blockNo < rangeEndBlockNo; blockNo += bufferedBlocks)
 		{
-			result.at(i) = buffer.at(i);
+			// the last block may be shorter than [blockSize] bytes and has a PKCS7 padding
+			// if a cipher padding size greater than 0 was specified in file header
+			size_t chunkPos = blockNo * blockSize;
+			size_t len = std::min(std::min<size_t>(bufferedBlocks, rangeEndBlockNo - blockNo) * blockSize, bodySize - chunkPos);
+			bool isLastChunk = chunkPos + len == bodySize;
+			size_t decryptedLen = blockDecryptor.DecryptBlocks(blockNo, encryptedFile.GetData() + offset + chunkPos, output.GetData() + chunkPos, len, blockSize, isLastChunk && padding > 0);
+			rangePlaintextLens[rangeNo] += decryptedLen;
+			RunStatistics::Get().AddData(len, decryptedLen, (len + blockSize - 1) / blockSize);
+			ProgressReporter::Get().AddData(len, (len + blockSize - 1) / blockSize);
 		}
+	});
 
-		return result;
-	}
-	else
+	// only the last block has a padding, so the plaintext is the whole body without it
+	size_t plaintextLen = 0;
+	for (size_t rangePlaintextLen : rangePlaintextLens)
 	{
-		throw std::runtime_error("Base initialization vector and crypto key can't be empty");
+		plaintextLen += rangePlaintextLen;
 	}
+	LOG_DEBUG("AES decryption of file finished");
+
+	StageTimer timer(Stage::Write);
+	output.Close(plaintextLen);
+	return true;
 }
 
 /*private*/ bool AESHelper::DecryptData(
@@ -222,4 +222,163 @@ bool AESHelper::DecryptFile(
 	{
 		throw std::runtime_error("Encrypted data, crypto key and initialization vector can't be empty");
 	}
-}
\ No newline at end of file
+}
+
+// decrypts the file body chunk by chunk and writes the plaintext to [output], returns the length
+// of the plaintext; [readChunk] provides the ciphertext of each chunk either by returning a
+// pointer to it or by reading it into the buffer it gets
+/*private*/ size_t AESHelper::DecryptFileChunks(
+	const std::string& encryptedFilePath, size_t fileSize, const ChunkReader& readChunk,
+	const std::vector<byte>& fileCryptoKey, const std::string& baseIVec, unsigned int blockSize,
+	unsigned int offset, unsigned int padding, std::ostream& output,
+	unsigned int threadCount, unsigned int bufferedBlocks)
+{
+	LOG_DEBUG("AES decryption of file '" << encryptedFilePath << "' started");
+
+	if (fileCryptoKey.size() > 0 && blockSize > 0 && threadCount > 0 && bufferedBlocks > 0)
+	{
+		// IVec in file header is base 64 encoded, the IVecs
+		// of the single blocks are derived from it
+		std::vector<byte> decodedFileIV;
+		Base64Helper::Decode(baseIVec, decodedFileIV);
+		BlockIVGenerator blockIVGenerator(decodedFileIV, fileCryptoKey);
+
+		// reading, decrypting and writing run at the same time as the stages of a pipeline: a
+		// reader provides the chunks of [bufferedBlocks] blocks one after the other, each of the
+		// [threadCount] decryption workers takes the next chunk that was read and an ordered
+		// writer passes the decrypted chunks on in their original order; the chunks go round
+		// through a fixed set of slots, so the reader can only be [slotCount] chunks ahead of the
+		// writer and the memory usage does not depend on the size of the file; each worker has
+		// its own decryptor, so the AES key schedule is only computed once per thread
+		struct ChunkSlot
+		{
+			PooledBuffer buffer;
+			unsigned long long chunkNo = 0;
+			size_t pos = 0;
+			size_t len = 0;
+			const byte *input = nullptr;
+			byte *output = nullptr;
+			size_t plaintextLen = 0;
+		};
+		size_t maxChunkSize = static_cast<size_t>(bufferedBlocks) * blockSize;
+		size_t slotCount = 2 * static_cast<size_t>(threadCount) + 2;
+		std::vector<ChunkSlot> slots(slotCount);
+		BoundedQueue<ChunkSlot *> freeSlots(slotCount), readSlots(slotCount), decryptedSlots(slotCount);
+		for (auto& slot : slots)
+		{
+			slot.buffer = BufferPool::Get().Acquire(maxChunkSize);
+			freeSlots.Push(&slot);
+		}
+		std::vector<std::unique_ptr<FileBlockDecryptor>> blockDecryptors(threadCount);
+		for (auto& blockDecryptor : blockDecryptors)
+		{
+			blockDecryptor.reset(new FileBlockDecryptor(fileCryptoKey, blockIVGenerator));
+		}
+		std::atomic<unsigned int> runningDecryptors(threadCount);
+		size_t plaintextLen = 0;
+
+		auto readStage = [&]()
+		{
+			unsigned long long chunkNo = 0;
+			ChunkSlot *slot = nullptr;
+			for (size_t byteNo = offset; byteNo < fileSize && freeSlots.Pop(slot); byteNo += maxChunkSize, ++chunkNo)
+			{
+				// if the blocks have to be read they are read to the buffer of the
+				// slot, where they are decrypted in place
+				slot->chunkNo = chunkNo;
+				slot->pos = byteNo;
+				slot->len = std::min(maxChunkSize, fileSize - byteNo);
+				slot->output = slot->buffer.GetData();
+				slot->input = readChunk(byteNo, slot->len, slot->output);
+				readSlots.Push(slot);
+			}
+			readSlots.Close();
+		};
+
+		auto decryptStage = [&](FileBlockDecryptor& blockDecryptor)
+		{
+			// each block is decrypted with its own initialization vector, which only depends on
+			// the block number, so the chunks can be decrypted in any order; the last block may
+			// be shorter than [blockSize] bytes and has a PKCS7 padding if a cipher padding size
+			// greater than 0 was specified in file header
+			ChunkSlot *slot = nullptr;
+			while (readSlots.Pop(slot))
+			{
+				bool isLastChunk = slot->pos + slot->len >= fileSize;
+				slot->plaintextLen = blockDecryptor.DecryptBlocks(slot->chunkNo * bufferedBlocks, slot->input, slot->output, slot->len, blockSize, isLastChunk && padding > 0);
+				decryptedSlots.Push(slot);
+			}
+			if (--runningDecryptors == 0)
+			{
+				decryptedSlots.Close();
+			}
+		};
+
+		auto writeStage = [&]()
+		{
+			// the chunks arrive in any order, a chunk which is ahead waits in its
+			// slot until all chunks before it were written
+			std::vector<ChunkSlot *> waitingSlots(slotCount, nullptr);
+			unsigned long long nextChunkNo = 0;
+			ChunkSlot *slot = nullptr;
+			while (decryptedSlots.Pop(slot))
+			{
+				waitingSlots[slot->chunkNo % slotCount] = slot;
+				while ((slot = waitingSlots[nextChunkNo % slotCount]) != nullptr && slot->chunkNo == nextChunkNo)
+				{
+					waitingSlots[nextChunkNo % slotCount] = nullptr;
+					plaintextLen += slot->plaintextLen;
+					{
+						StageTimer timer(Stage::Write);
+						output.write(reinterpret_cast<const char *>(slot->output), slot->plaintextLen);
+						if (!output.good())
+						{
+							throw std::runtime_error("Decrypted data could not be written to the output");
+						}
+					}
+					RunStatistics::Get().AddData(slot->len, slot->plaintextLen, (slot->len + blockSize - 1) / blockSize);
+					ProgressReporter::Get().AddData(slot->len, (slot->len + blockSize - 1) / blockSize);
+
+					++nextChunkNo;
+					freeSlots.Push(slot);
+				}
+			}
+		};
+
+		// the reader and the writer need a thread of their own besides the decryption workers,
+		// the stage that fails first stops the other ones, its error is rethrown by the pool
+		ThreadPool threadPool(threadCount + 2);
+		threadPool.ParallelFor(threadCount + 2, [&](size_t stageNo)
+		{
+			try
+			{
+				if (stageNo == 0)
+				{
+					readStage();
+				}
+				else if (stageNo == 1)
+				{
+					writeStage();
+				}
+				else
+				{
+					decryptStage(*blockDecryptors[stageNo - 2]);
+				}
+			}
+			catch (...)
+			{
+				freeSlots.Abort();
+				readSlots.Abort();
+				decryptedSlots.Abort();
+				throw;
+			}
+		});
+
+		LOG_DEBUG("AES decryption of file finished");
+		return plaintextLen;
+	}
+	else
+	{
+		throw std::runtime_error("Crypto key for file can't be empty and block size, thread count and buffered block count must be bigger than zero");
+	}
+}
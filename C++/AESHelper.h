@@ -1,9 +1,13 @@
 #ifndef AESDECRYPTOR_H
 #define AESDECRYPTOR_H
 
+#include <functional>
+#include <ostream>
 #include <string>
 #include <vector>
 #include "TypeDefs.h"
+#include "MappedFile.h"
+#include "OutputFile.h"
 #include "filters.h"
 
 class AESHelper
@@ -11,20 +15,42 @@ class AESHelper
 public:
 	AESHelper() = delete;
 
+	// number of file blocks per thread held in memory at once while streaming a file
+	static const unsigned int DefaultBufferedBlocks = 4;
+
 	static bool DecryptDataPBKDF2(
 		const std::string& data, const std::string& pbkdf2Password,
 		const std::string& pbkdf2Salt, unsigned int pbkdf2Iterations, std::string& decryptedData);
 	static bool DecryptFile(
 		const std::string& encryptedFilePath, const std::vector<byte>& fileCryptoKey,
 		const std::string& baseIVec, unsigned int blockSize, unsigned int offset,
-		unsigned int padding, std::vector<byte>& decryptedFileBytes);
+		unsigned int padding, std::ostream& output, unsigned int threadCount = 1,
+		unsigned int bufferedBlocks = DefaultBufferedBlocks);
+	static bool DecryptFile(
+		const MappedFile& encryptedFile, const std::vector<byte>& fileCryptoKey,
+		const std::string& baseIVec, unsigned int blockSize, unsigned int offset,
+		unsigned int padding, std::ostream& output, unsigned int threadCount = 1,
+		unsigned int bufferedBlocks = DefaultBufferedBlocks);
+	static bool DecryptFile(
+		const MappedFile& encryptedFile, const std::vector<byte>& fileCryptoKey,
+		const std::string& baseIVec, unsigned int blockSize, unsigned int offset,
+		unsigned int padding, OutputFile& output, unsigned int threadCount = 1,
+		unsigned int bufferedBlocks = DefaultBufferedBlocks);
 
 private:
-	static std::vector<byte> ComputeBlockIVec(std::vector<byte> ivec, unsigned long seed, std::vector<byte> key);
+	// returns the ciphertext of [len] bytes at file position [pos],
+	// the given buffer can hold [len] bytes and may be used to read them into
+	using ChunkReader = std::function<const byte *(size_t pos, size_t len, byte *buffer)>;
+
 	static bool DecryptData(
 		const std::vector<byte>& data, const std::vector<byte>& cryptoKey, const std::vector<byte>& IVec, std::string& output,
 		bool isUserGeneratedData, 
 		CryptoPP::BlockPaddingSchemeDef::BlockPaddingScheme paddingMode = CryptoPP::StreamTransformationFilter::PKCS_PADDING);
+	static size_t DecryptFileChunks(
+		const std::string& encryptedFilePath, size_t fileSize, const ChunkReader& readChunk,
+		const std::vector<byte>& fileCryptoKey, const std::string& baseIVec, unsigned int blockSize,
+		unsigned int offset, unsigned int padding, std::ostream& output,
+		unsigned int threadCount, unsigned int bufferedBlocks);
 };
 
 #endif
\ No newline at end of file
@@ -1,16 +1,17 @@
 #include "AccountData.h"
 #include <fstream>
-#include <iostream>
+#include <limits>
 #include <vector>
 #include <stdexcept>
 #include "TypeDefs.h"
+#include "JSONReader.h"
+#include "Log.h"
 
-// this method should ideally be implemented using a proper JSON library,
-// but for the purpose of demonstrating which infos are needed from
-// the file header simple string searches should be sufficient
+// the key file is read in one pass, every user object which contains
+// an encrypted private key, a salt and an iteration count is kept
 bool AccountData::ParseBCKeyFile(const std::string& keyfilePath)
 {
-	std::cout << "Parsing .bckey file: '" << keyfilePath << "'" << std::endl;
+	LOG_DEBUG("Parsing .bckey file: '" << keyfilePath << "'");
 
 	if (keyfilePath.substr(keyfilePath.length() - 6) != ".bckey")
 	{
@@ -35,78 +36,69 @@ bool AccountData::ParseBCKeyFile(const std::string& keyfilePath)
 	keyFileData.resize(static_cast<size_t>(pos));
 	keyFile.read(&keyFileData[0], pos);
 
-	// find the (first) user object
-	std::string searchString = R"("users")";
-	size_t posUserBegin = keyFileData.find(searchString);
-	posUserBegin = keyFileData.find("{", posUserBegin + searchString.length());
-	size_t posUserEnd = keyFileData.find("}", posUserBegin + 1);
-
-	// and the 'privateKey' within
-	searchString = R"("privateKey")";
-	size_t posBegin = keyFileData.find(searchString, posUserBegin + 1);
-	posBegin = keyFileData.find(R"(")", posBegin + searchString.length());
-
-	// check if we are still in the right block / JSON object
-	if (posBegin > posUserEnd)
-	{
-		throw std::runtime_error("The (first) user object has no suitable 'privateKey' value");
-	}
-	size_t posEnd = keyFileData.find(R"(")", posBegin + 1);
-
-	if (posBegin != std::string::npos && posEnd != std::string::npos && posEnd - posBegin > 0)
+	this->m_users.clear();
+	try
 	{
-		this->m_encryptedPrivateKey = keyFileData.substr(posBegin + 1, posEnd - posBegin - 1);
+		// a byte order mark in front of the document is ignored
+		std::string_view document(keyFileData);
+		if (document.substr(0, 3) == "\xef\xbb\xbf")
+		{
+			document.remove_prefix(3);
+		}
+
+		JSONReader reader(document);
+		std::string_view name;
+		reader.BeginObject();
+		while (reader.NextMember(name))
+		{
+			if (name != "users")
+			{
+				reader.SkipValue();
+				continue;
+			}
+
+			reader.BeginArray();
+			while (reader.NextElement())
+			{
+				AccountUser user;
+				bool hasIterations = false;
+				reader.BeginObject();
+				while (reader.NextMember(name))
+				{
+					if (name == "id") { user.id = reader.ReadString(); }
+					else if (name == "privateKey") { user.encryptedPrivateKey = reader.ReadString(); }
+					else if (name == "salt") { user.pbkdf2Salt = reader.ReadString(); }
+					else if (name == "kdfIterations")
+					{
+						unsigned long long iterations = reader.ReadUnsignedInteger();
+						if (iterations > std::numeric_limits<unsigned int>::max())
+						{
+							throw std::runtime_error("Could not convert iterations value to integer");
+						}
+						user.pbkdf2Iterations = static_cast<unsigned int>(iterations);
+						hasIterations = true;
+					}
+					else { reader.SkipValue(); }
+				}
+
+				if (user.encryptedPrivateKey.length() > 0 && user.pbkdf2Salt.length() > 0 && hasIterations)
+				{
+					this->m_users.push_back(std::move(user));
+				}
+			}
+		}
 	}
-	else
+	catch (const std::runtime_error& e)
 	{
-		throw std::runtime_error("Could not find encrypted private key in keyfile");
+		throw std::runtime_error(std::string("Could not parse keyfile: ") + e.what());
 	}
 
-	// and the 'salt' within
-	searchString = R"("salt")";
-	posBegin = keyFileData.find(searchString, posUserBegin + 1);
-	posBegin = keyFileData.find(R"(")", posBegin + searchString.length());
-
-	// check if we are still in the right block / JSON object
-	if (posBegin > posUserEnd)
+	if (this->m_users.empty())
 	{
-		throw std::runtime_error("The (first) user object has no suitable 'salt' value");
+		throw std::runtime_error("Could not find a user with encrypted private key, salt and iteration count in keyfile");
 	}
-	posEnd = keyFileData.find(R"(")", posBegin + 1);
 
-	if (posBegin != std::string::npos && posEnd != std::string::npos && posEnd - posBegin > 0)
-	{
-		this->m_pbkdf2Salt = keyFileData.substr(posBegin + 1, posEnd - posBegin - 1);
-	}
-	else
-	{
-		throw std::runtime_error("Could not find salt in keyfile");
-	}
-
-	// and the 'kdfIterations' within
-	searchString = R"("kdfIterations")";
-	posBegin = keyFileData.find(searchString, posUserBegin + 1);
-	posBegin = keyFileData.find(":", posBegin + searchString.length());
-
-	// check if we are still in the right block / JSON object
-	if (posBegin > posUserEnd)
-	{
-		throw std::runtime_error("The (first) user object has no suitable 'kdfIterations' value");
-	}
-	posEnd = keyFileData.find(",", posBegin + 1);
-
-	if (posBegin != std::string::npos && posEnd != std::string::npos && posEnd - posBegin > 0)
-	{
-		std::string iterations = keyFileData.substr(posBegin + 1, posEnd - posBegin - 1);
-		try { this->m_pbkdf2Iterations = std::stoi(iterations); }
-		catch (...) { throw std::runtime_error("Could not convert iterations value to integer"); }
-	}
-	else
-	{
-		throw std::runtime_error("Could not find iteration count in keyfile");
-	}
-
-	std::cout << "Parsing finished" << std::endl;
+	LOG_DEBUG("Parsing finished");
 
 	return true;
 }
@@ -131,15 +123,25 @@ std::string AccountData::GetPassword() const
 
 std::string AccountData::GetPBKDF2Salt() const
 {
-	return this->m_pbkdf2Salt;
+	return this->m_users.at(0).pbkdf2Salt;
 }
 
 unsigned int AccountData::GetPBKDF2Iterations() const
 {
-	return this->m_pbkdf2Iterations;
+	return this->m_users.at(0).pbkdf2Iterations;
 }
 
 std::string AccountData::GetEncryptedPrivateKey() const
 {
-	return this->m_encryptedPrivateKey;
+	return this->m_users.at(0).encryptedPrivateKey;
+}
+
+std::string AccountData::GetUserId() const
+{
+	return this->m_users.at(0).id;
+}
+
+const std::vector<AccountUser>& AccountData::GetUsers() const
+{
+	return this->m_users;
 }
\ No newline at end of file
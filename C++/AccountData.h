@@ -2,7 +2,18 @@
 #define ACCOUNTINFORMATION_H
 
 #include <string>
+#include <vector>
 
+// one entry of 'users' in the .bckey file
+struct AccountUser
+{
+	std::string id;
+	std::string encryptedPrivateKey;
+	std::string pbkdf2Salt;
+	unsigned int pbkdf2Iterations = 0;
+};
+
+// the getters for the id, private key, salt and iterations return the ones of the (first) user
 class AccountData
 {
 public:
@@ -17,13 +28,13 @@ public:
 	std::string GetPBKDF2Salt() const;
 	unsigned int GetPBKDF2Iterations() const;
 	std::string GetEncryptedPrivateKey() const;
+	std::string GetUserId() const;
+	const std::vector<AccountUser>& GetUsers() const;
 
 private:
 	std::string m_bckeyFilepath;
 	std::string m_password;
-	std::string m_encryptedPrivateKey;
-	std::string m_pbkdf2Salt;
-	unsigned int m_pbkdf2Iterations;
+	std::vector<AccountUser> m_users;
 };
 
 #endif
\ No newline at end of file
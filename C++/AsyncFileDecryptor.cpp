@@ -0,0 +1,325 @@
+#include "AsyncFileDecryptor.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "Base64Helper.h"
+#include "BlockIVGenerator.h"
+#include "BoundedQueue.h"
+#include "Log.h"
+#include "ProgressReporter.h"
+#include "RunStatistics.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+AsyncFileDecryptor::AsyncFileDecryptor(
+	IOBackend ioBackend, bool isDirectIO, unsigned int threadCount,
+	unsigned int bufferedBlocks /* = AESHelper::DefaultBufferedBlocks*/, unsigned int queueDepth /* = DefaultQueueDepth*/)
+	: m_ioBackend(ioBackend), m_isDirectIO(isDirectIO), m_threadCount(threadCount), m_bufferedBlocks(bufferedBlocks),
+	m_queueDepth(queueDepth), m_threadPool(threadCount + 1), m_blockDecryptors(threadCount)
+{
+	if (threadCount == 0 || bufferedBlocks == 0 || queueDepth == 0)
+	{
+		throw std::runtime_error("Thread count, buffered block count and queue depth must be bigger than zero");
+	}
+}
+
+void AsyncFileDecryptor::Decrypt(
+	const std::string& encryptedFilePath, const std::vector<byte>& fileCryptoKey,
+	const std::string& baseIVec, unsigned int blockSize, unsigned int offset,
+	unsigned int padding, const std::string& outputFilePath)
+{
+#ifdef _WIN32
+	throw std::runtime_error("Decrypting files without mapping them is not supported on this platform");
+#else
+	LOG_DEBUG("AES decryption of file '" << encryptedFilePath << "' started");
+
+	if (fileCryptoKey.empty() || blockSize == 0)
+	{
+		throw std::runtime_error("Crypto key for file can't be empty and block size must be bigger than zero");
+	}
+
+	// direct I/O bypasses the page cache, file positions and lengths must be aligned then; a
+	// file system which doesn't support it gets the file opened normally instead
+	int directFlag = 0;
+#ifdef O_DIRECT
+	directFlag = this->m_isDirectIO ? O_DIRECT : 0;
+#endif
+	int inputFile = open(encryptedFilePath.c_str(), O_RDONLY | directFlag);
+	if (inputFile < 0 && directFlag != 0 && errno == EINVAL)
+	{
+		inputFile = open(encryptedFilePath.c_str(), O_RDONLY);
+	}
+	struct stat fileStatus;
+	if (inputFile < 0 || fstat(inputFile, &fileStatus) != 0)
+	{
+		if (inputFile >= 0)
+		{
+			close(inputFile);
+		}
+		std::string errorMsg("Encrypted file (" + encryptedFilePath + ") can't be opened (make sure the provided path is correct, the file exists and you have the right to open the file)");
+		throw std::runtime_error(errorMsg.c_str());
+	}
+	unsigned long long fileSize = static_cast<unsigned long long>(fileStatus.st_size);
+	unsigned long long bodySize = fileSize > offset ? fileSize - offset : 0;
+
+	// like the mapped output file, the space for the whole body is reserved up front
+	// and the padding of the last block is cut off at the end
+	int outputFile = open(outputFilePath.c_str(), O_RDWR | O_CREAT | O_TRUNC | directFlag, 0644);
+	if (outputFile < 0 && directFlag != 0 && errno == EINVAL)
+	{
+		outputFile = open(outputFilePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	}
+	if (outputFile < 0)
+	{
+		close(inputFile);
+		throw std::runtime_error("Can't create decrypted file at location '" + outputFilePath + "' (make sure you have the necessary file system rights to write to this location or specify another path)");
+	}
+	int allocateResult = bodySize > 0 ? posix_fallocate(outputFile, 0, static_cast<off_t>(bodySize)) : 0;
+	if (allocateResult == ENOSPC)
+	{
+		close(inputFile);
+		close(outputFile);
+		throw std::runtime_error("Can't reserve " + std::to_string(bodySize) + " bytes for decrypted file at location '" + outputFilePath + "' (make sure there is enough free disk space)");
+	}
+	bool isDirectInput = directFlag != 0 && (fcntl(inputFile, F_GETFL) & directFlag) != 0;
+	bool isDirectOutput = directFlag != 0 && (fcntl(outputFile, F_GETFL) & directFlag) != 0;
+
+	try
+	{
+		unsigned long long plaintextLen = this->DecryptBody(inputFile, outputFile, isDirectInput, isDirectOutput, bodySize, fileCryptoKey, baseIVec, blockSize, offset, padding);
+
+		StageTimer timer(Stage::Write);
+		if (ftruncate(outputFile, static_cast<off_t>(plaintextLen)) != 0)
+		{
+			throw std::runtime_error("Decrypted file at location '" + outputFilePath + "' could not be cut to its final size");
+		}
+	}
+	catch (const std::exception&)
+	{
+		// reads and writes of the failed file may still be in flight, the buffers are
+		// only given to the next file once all of them are done
+		this->m_asyncIO.reset();
+		close(inputFile);
+		close(outputFile);
+		throw;
+	}
+
+	close(inputFile);
+	if (close(outputFile) != 0)
+	{
+		throw std::runtime_error("Decrypted file at location '" + outputFilePath + "' could not be written completely");
+	}
+
+	LOG_DEBUG("AES decryption of file finished");
+#endif
+}
+
+// decrypts the body of an opened file and returns the length of the plaintext
+/*private*/ unsigned long long AsyncFileDecryptor::DecryptBody(
+	int inputFile, int outputFile, bool isDirectInput, bool isDirectOutput, unsigned long long bodySize,
+	const std::vector<byte>& fileCryptoKey, const std::string& baseIVec, unsigned int blockSize,
+	unsigned int offset, unsigned int padding)
+{
+	std::vector<byte> decodedFileIV;
+	Base64Helper::Decode(baseIVec, decodedFileIV);
+	BlockIVGenerator blockIVGenerator(decodedFileIV, fileCryptoKey);
+
+	// with direct I/O the chunks are grown to a multiple of the alignment, so every chunk
+	// of plaintext starts at an aligned position of the output file; the reads start at
+	// the aligned position before their chunk (the header makes the body start anywhere)
+	// and the last one is rounded up beyond the end of the file, so the buffers are
+	// one alignment unit bigger than the chunks
+	const size_t alignment = AsyncIO::BufferAlignment;
+	unsigned int bufferedBlocks = this->m_bufferedBlocks;
+	while (isDirectOutput && (static_cast<size_t>(bufferedBlocks) * blockSize) % alignment != 0)
+	{
+		++bufferedBlocks;
+	}
+	size_t chunkSize = static_cast<size_t>(bufferedBlocks) * blockSize;
+	size_t bufferSize = chunkSize + (isDirectInput ? alignment : 0);
+	if (!this->m_asyncIO || this->m_asyncIO->GetBufferSize() < bufferSize)
+	{
+		this->m_asyncIO.reset();
+		this->m_asyncIO.reset(new AsyncIO(this->m_ioBackend, this->m_queueDepth, bufferSize));
+	}
+	for (auto& blockDecryptor : this->m_blockDecryptors)
+	{
+		if (blockDecryptor)
+		{
+			blockDecryptor->SetKey(fileCryptoKey, blockIVGenerator);
+		}
+		else
+		{
+			blockDecryptor.reset(new FileBlockDecryptor(fileCryptoKey, blockIVGenerator));
+		}
+	}
+
+	// every buffer holds a chunk of [bufferedBlocks] blocks and goes round from reading the
+	// ciphertext to decrypting it in place and writing the plaintext, after which it reads
+	// the next chunk; reading, decrypting and writing run at the same time as the stages of a
+	// pipeline: an I/O thread submits the reads and writes of all buffers and hands each
+	// buffer that was read to the decryption workers, which hand it back once it is decrypted;
+	// the chunks are written at their own positions, so their order doesn't matter; each
+	// worker has its own decryptor, so the AES key schedule is only computed once per thread
+	AsyncIO& asyncIO = *this->m_asyncIO;
+	unsigned int queueDepth = this->m_queueDepth;
+	BoundedQueue<unsigned int> readBuffers(queueDepth), decryptedBuffers(queueDepth);
+	std::vector<unsigned long long> chunkPositions(queueDepth);
+	std::vector<size_t> chunkPlaintextLens(queueDepth);
+	unsigned long long plaintextLen = 0;
+
+	auto ioStage = [&]()
+	{
+		// submits the read of the next chunk into a buffer, returns false if the file is done
+		unsigned long long nextChunkPos = 0;
+		auto readNextChunk = [&](unsigned int bufferNo)
+		{
+			if (nextChunkPos >= bodySize)
+			{
+				return false;
+			}
+			chunkPositions[bufferNo] = nextChunkPos;
+			size_t len = static_cast<size_t>(std::min<unsigned long long>(chunkSize, bodySize - nextChunkPos));
+			unsigned long long filePos = offset + nextChunkPos;
+			size_t shift = isDirectInput ? static_cast<size_t>(filePos % alignment) : 0;
+			size_t readLen = isDirectInput ? (shift + len + alignment - 1) / alignment * alignment : len;
+			asyncIO.SubmitRead(inputFile, bufferNo, readLen, filePos - shift, shift + len);
+			nextChunkPos += len;
+			return true;
+		};
+
+		// submits the write of a decrypted chunk, the ragged end of the last chunk is written
+		// as a whole aligned unit with zeros behind the plaintext, which are cut off with the
+		// padding at the end; a last chunk of padding only has nothing to write and its buffer
+		// is done right away
+		auto writeChunk = [&](unsigned int bufferNo)
+		{
+			unsigned long long chunkPos = chunkPositions[bufferNo];
+			size_t len = static_cast<size_t>(std::min<unsigned long long>(chunkSize, bodySize - chunkPos));
+			size_t decryptedLen = chunkPlaintextLens[bufferNo];
+			plaintextLen += decryptedLen;
+			RunStatistics::Get().AddData(len, decryptedLen, (len + blockSize - 1) / blockSize);
+			ProgressReporter::Get().AddData(len, (len + blockSize - 1) / blockSize);
+
+			size_t writeLen = decryptedLen;
+			if (isDirectOutput && writeLen % alignment != 0)
+			{
+				writeLen = (decryptedLen + alignment - 1) / alignment * alignment;
+				std::memset(asyncIO.GetBuffer(bufferNo) + decryptedLen, 0, writeLen - decryptedLen);
+			}
+			if (writeLen > 0)
+			{
+				asyncIO.SubmitWrite(outputFile, bufferNo, writeLen, chunkPos);
+			}
+		};
+
+		for (unsigned int bufferNo = 0; bufferNo < queueDepth; ++bufferNo)
+		{
+			readNextChunk(bufferNo);
+		}
+
+		// the decrypted buffers are written as soon as the I/O thread comes by: the workers wake
+		// its wait for reads and writes when they hand back a buffer, so the write is submitted
+		// right away; it only waits for a decryption alone if there is no read or write in flight
+		unsigned int decryptingCount = 0;
+		std::vector<IOCompletion> completions;
+		unsigned int bufferNo = 0;
+		while (asyncIO.GetPendingCount() > 0 || decryptingCount > 0)
+		{
+			while (decryptedBuffers.TryPop(bufferNo))
+			{
+				--decryptingCount;
+				writeChunk(bufferNo);
+			}
+
+			// the queues are only aborted if a worker failed, its error is rethrown by the pool
+			if (asyncIO.GetPendingCount() == 0)
+			{
+				if (decryptingCount > 0)
+				{
+					if (!decryptedBuffers.Pop(bufferNo))
+					{
+						return;
+					}
+					--decryptingCount;
+					writeChunk(bufferNo);
+				}
+				continue;
+			}
+
+			completions.clear();
+			asyncIO.WaitCompletions(completions);
+			for (const IOCompletion& completion : completions)
+			{
+				if (completion.isWrite)
+				{
+					readNextChunk(completion.bufferNo);
+				}
+				else if (!readBuffers.Push(completion.bufferNo))
+				{
+					return;
+				}
+				else
+				{
+					++decryptingCount;
+				}
+			}
+		}
+		readBuffers.Close();
+	};
+
+	auto decryptStage = [&](FileBlockDecryptor& blockDecryptor)
+	{
+		// the last block may be shorter than [blockSize] bytes and has a PKCS7 padding
+		// if a cipher padding size greater than 0 was specified in file header; the
+		// plaintext of a direct read is moved to the aligned start of its buffer
+		unsigned int bufferNo = 0;
+		while (readBuffers.Pop(bufferNo))
+		{
+			unsigned long long chunkPos = chunkPositions[bufferNo];
+			size_t len = static_cast<size_t>(std::min<unsigned long long>(chunkSize, bodySize - chunkPos));
+			bool isLastChunk = chunkPos + len == bodySize;
+			size_t shift = isDirectInput ? static_cast<size_t>((offset + chunkPos) % alignment) : 0;
+			byte *chunk = asyncIO.GetBuffer(bufferNo);
+			size_t decryptedLen = blockDecryptor.DecryptBlocks(chunkPos / blockSize, chunk + shift, len, blockSize, isLastChunk && padding > 0);
+			if (shift > 0)
+			{
+				std::memmove(chunk, chunk + shift, decryptedLen);
+			}
+			chunkPlaintextLens[bufferNo] = decryptedLen;
+			decryptedBuffers.Push(bufferNo);
+			asyncIO.Wake();
+		}
+	};
+
+	// the I/O thread needs a thread of its own besides the decryption workers, the
+	// stage that fails first stops the other ones, its error is rethrown by the pool
+	this->m_threadPool.ParallelFor(this->m_threadCount + 1, [&](size_t stageNo)
+	{
+		try
+		{
+			if (stageNo == 0)
+			{
+				ioStage();
+			}
+			else
+			{
+				decryptStage(*this->m_blockDecryptors[stageNo - 1]);
+			}
+		}
+		catch (...)
+		{
+			readBuffers.Abort();
+			decryptedBuffers.Abort();
+			asyncIO.Wake();
+			throw;
+		}
+	});
+
+	return plaintextLen;
+}
@@ -0,0 +1,56 @@
+#ifndef ASYNCFILEDECRYPTOR_H
+#define ASYNCFILEDECRYPTOR_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "TypeDefs.h"
+#include "AESHelper.h"
+#include "AsyncIO.h"
+#include "FileBlockDecryptor.h"
+#include "ThreadPool.h"
+
+// decrypts the files of a run one after the other without mapping them: every file is read
+// and written in chunks of [bufferedBlocks] blocks through the buffers of AsyncIO, with
+// [queueDepth] chunks in flight, while [threadCount] workers decrypt the chunks which were read;
+// the threads, the buffers (and with them the io_uring ring and its registered buffers) and the
+// decryptors of the workers are set up for the first file and reused for all following ones,
+// the buffers are only set up again if a file needs bigger ones (i.e. has bigger blocks)
+class AsyncFileDecryptor
+{
+public:
+	AsyncFileDecryptor(
+		IOBackend ioBackend, bool isDirectIO, unsigned int threadCount,
+		unsigned int bufferedBlocks = AESHelper::DefaultBufferedBlocks, unsigned int queueDepth = DefaultQueueDepth);
+
+	AsyncFileDecryptor(const AsyncFileDecryptor&) = delete;
+	AsyncFileDecryptor& operator=(const AsyncFileDecryptor&) = delete;
+
+	// decrypts the body of the encrypted file, which starts at [offset], to the output file,
+	// which is created or overwritten
+	void Decrypt(
+		const std::string& encryptedFilePath, const std::vector<byte>& fileCryptoKey,
+		const std::string& baseIVec, unsigned int blockSize, unsigned int offset,
+		unsigned int padding, const std::string& outputFilePath);
+
+	// number of chunks being read or written at once
+	static const unsigned int DefaultQueueDepth = 32;
+
+private:
+	IOBackend m_ioBackend;
+	bool m_isDirectIO;
+	unsigned int m_threadCount;
+	unsigned int m_bufferedBlocks;
+	unsigned int m_queueDepth;
+	// the I/O thread and the decryption workers
+	ThreadPool m_threadPool;
+	std::unique_ptr<AsyncIO> m_asyncIO;
+	std::vector<std::unique_ptr<FileBlockDecryptor>> m_blockDecryptors;
+
+	unsigned long long DecryptBody(
+		int inputFile, int outputFile, bool isDirectInput, bool isDirectOutput, unsigned long long bodySize,
+		const std::vector<byte>& fileCryptoKey, const std::string& baseIVec, unsigned int blockSize,
+		unsigned int offset, unsigned int padding);
+};
+
+#endif
@@ -0,0 +1,471 @@
+#include "AsyncIO.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+AsyncIO::AsyncIO(IOBackend backend, unsigned int bufferCount, size_t bufferSize)
+	: m_backend(backend), m_bufferCount(bufferCount), m_requests(bufferCount)
+{
+	if (bufferCount == 0 || bufferSize == 0)
+	{
+		throw std::runtime_error("At least one buffer with a size bigger than zero is needed for reading and writing files");
+	}
+
+#ifdef _WIN32
+	throw std::runtime_error("Reading and writing files without mapping them is not supported on this platform");
+#else
+	// the memory of the pool is page aligned, so every buffer starts at an aligned
+	// address, as needed for direct I/O; it is recycled for the next file
+	this->m_bufferSize = (bufferSize + AsyncIO::BufferAlignment - 1) / AsyncIO::BufferAlignment * AsyncIO::BufferAlignment;
+	this->m_buffers = BufferPool::Get().Acquire(this->m_bufferSize * bufferCount);
+
+	if (backend == IOBackend::IOUring && !this->SetupRing())
+	{
+		this->m_backend = IOBackend::PRead;
+	}
+#endif
+}
+
+AsyncIO::~AsyncIO()
+{
+	// the kernel may still write to the buffers, so all requests have to be done first
+	while (this->m_ring >= 0 && this->m_pendingCount > 0)
+	{
+		try { this->ReapRing(true); }
+		catch (...) {}
+	}
+	this->CloseRing();
+}
+
+byte *AsyncIO::GetBuffer(unsigned int bufferNo)
+{
+	return this->m_buffers.GetData() + static_cast<size_t>(bufferNo) * this->m_bufferSize;
+}
+
+size_t AsyncIO::GetBufferSize() const
+{
+	return this->m_bufferSize;
+}
+
+unsigned int AsyncIO::GetBufferCount() const
+{
+	return this->m_bufferCount;
+}
+
+IOBackend AsyncIO::GetBackend() const
+{
+	return this->m_backend;
+}
+
+void AsyncIO::SubmitRead(int file, unsigned int bufferNo, size_t len, unsigned long long filePos, size_t minLen /* = 0*/)
+{
+	this->Submit(file, bufferNo, len, minLen, filePos, false);
+}
+
+void AsyncIO::SubmitWrite(int file, unsigned int bufferNo, size_t len, unsigned long long filePos)
+{
+	this->Submit(file, bufferNo, len, 0, filePos, true);
+}
+
+void AsyncIO::WaitCompletions(std::vector<IOCompletion>& completions)
+{
+	if (this->m_completions.empty() && this->m_pendingCount == 0)
+	{
+		throw std::runtime_error("There is no read or write to wait for");
+	}
+
+	// everything that is done already is taken along, the requests submitted since the last
+	// call are handed to the kernel together with the wait for the first completion
+	if (this->m_ring >= 0)
+	{
+		if (this->m_wakeupEvent >= 0)
+		{
+			// a completion which was reaped already may have left the event signaled, the caller
+			// just waits again then; the submission isn't delayed by the wait on the event
+			if (this->m_unsubmittedCount > 0)
+			{
+				this->EnterRing(false);
+			}
+			this->ReapRing(false);
+			if (this->m_completions.empty())
+			{
+				// the rest of a short transfer may have been queued by the reaping
+				if (this->m_unsubmittedCount > 0)
+				{
+					this->EnterRing(false);
+				}
+				this->WaitWakeupEvent();
+				this->ReapRing(false);
+			}
+		}
+		else
+		{
+			this->ReapRing(this->m_completions.empty());
+			while (this->m_completions.empty())
+			{
+				this->ReapRing(true);
+			}
+		}
+
+		// the rest of a short transfer isn't left behind while the caller works on the completions
+		if (this->m_unsubmittedCount > 0)
+		{
+			this->EnterRing(false);
+		}
+	}
+
+	completions.insert(completions.end(), this->m_completions.begin(), this->m_completions.end());
+	this->m_completions.clear();
+}
+
+void AsyncIO::Wake()
+{
+#ifdef __linux__
+	if (this->m_wakeupEvent >= 0)
+	{
+		eventfd_write(this->m_wakeupEvent, 1);
+	}
+#endif
+}
+
+unsigned int AsyncIO::GetPendingCount() const
+{
+	return this->m_pendingCount + static_cast<unsigned int>(this->m_completions.size());
+}
+
+/*private*/ void AsyncIO::Submit(int file, unsigned int bufferNo, size_t len, size_t minLen, unsigned long long filePos, bool isWrite)
+{
+	if (bufferNo >= this->m_bufferCount || len == 0 || len > this->m_bufferSize || minLen > len || this->m_requests[bufferNo].isPending)
+	{
+		throw std::runtime_error("Invalid read or write of buffer " + std::to_string(bufferNo));
+	}
+
+	Request& request = this->m_requests[bufferNo];
+	request.file = file;
+	request.isWrite = isWrite;
+	request.isPending = true;
+	request.len = len;
+	request.minLen = minLen > 0 ? minLen : len;
+	request.doneLen = 0;
+	request.filePos = filePos;
+	++this->m_pendingCount;
+
+	if (this->m_ring >= 0)
+	{
+		this->SubmitToRing(bufferNo);
+	}
+	else
+	{
+		this->TransferSynchronously(bufferNo);
+	}
+}
+
+// maps the submission and completion rings shared with the kernel and registers the buffers,
+// returns false if io_uring can't be used at all
+/*private*/ bool AsyncIO::SetupRing()
+{
+#ifdef __linux__
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	int ring = static_cast<int>(syscall(__NR_io_uring_setup, this->m_bufferCount, &params));
+	if (ring < 0)
+	{
+		return false;
+	}
+	this->m_ring = ring;
+
+	this->m_submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	this->m_completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool isSingleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (isSingleMapping)
+	{
+		this->m_submissionRingSize = this->m_completionRingSize = std::max(this->m_submissionRingSize, this->m_completionRingSize);
+	}
+
+	void *submissionRing = mmap(nullptr, this->m_submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+	this->m_submissionRing = submissionRing != MAP_FAILED ? submissionRing : nullptr;
+	if (isSingleMapping)
+	{
+		this->m_completionRing = this->m_submissionRing;
+	}
+	else
+	{
+		void *completionRing = mmap(nullptr, this->m_completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+		this->m_completionRing = completionRing != MAP_FAILED ? completionRing : nullptr;
+	}
+	this->m_submissionEntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+	void *submissionEntries = mmap(nullptr, this->m_submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+	this->m_submissionEntries = submissionEntries != MAP_FAILED ? submissionEntries : nullptr;
+
+	if (this->m_submissionRing == nullptr || this->m_completionRing == nullptr || this->m_submissionEntries == nullptr)
+	{
+		this->CloseRing();
+		return false;
+	}
+
+	byte *submissionRingBytes = static_cast<byte *>(this->m_submissionRing);
+	byte *completionRingBytes = static_cast<byte *>(this->m_completionRing);
+	this->m_sqHead = reinterpret_cast<unsigned int *>(submissionRingBytes + params.sq_off.head);
+	this->m_sqTail = reinterpret_cast<unsigned int *>(submissionRingBytes + params.sq_off.tail);
+	this->m_sqMask = reinterpret_cast<unsigned int *>(submissionRingBytes + params.sq_off.ring_mask);
+	this->m_sqArray = reinterpret_cast<unsigned int *>(submissionRingBytes + params.sq_off.array);
+	this->m_cqHead = reinterpret_cast<unsigned int *>(completionRingBytes + params.cq_off.head);
+	this->m_cqTail = reinterpret_cast<unsigned int *>(completionRingBytes + params.cq_off.tail);
+	this->m_cqMask = reinterpret_cast<unsigned int *>(completionRingBytes + params.cq_off.ring_mask);
+	this->m_cqEntries = completionRingBytes + params.cq_off.cqes;
+
+	// registered buffers are pinned once instead of for every request, this can fail
+	// because of the limit of locked memory, the buffers are passed with each request then
+	std::vector<iovec> bufferVectors(this->m_bufferCount);
+	for (unsigned int bufferNo = 0; bufferNo < this->m_bufferCount; ++bufferNo)
+	{
+		bufferVectors[bufferNo].iov_base = this->GetBuffer(bufferNo);
+		bufferVectors[bufferNo].iov_len = this->m_bufferSize;
+	}
+	this->m_hasFixedBuffers = syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS, bufferVectors.data(), this->m_bufferCount) == 0;
+
+	// reads and writes of registered buffers exist since Linux 5.1, the plain ones and the probe
+	// for the supported operations only since 5.6; a ring that can do neither isn't used
+	const unsigned int probeOpCount = 256;
+	std::vector<byte> probeBytes(sizeof(io_uring_probe) + probeOpCount * sizeof(io_uring_probe_op));
+	io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(probeBytes.data());
+	bool hasProbe = syscall(__NR_io_uring_register, ring, IORING_REGISTER_PROBE, probe, probeOpCount) == 0;
+	auto isSupported = [&](unsigned int operation)
+	{
+		if (!hasProbe)
+		{
+			return operation == IORING_OP_READ_FIXED || operation == IORING_OP_WRITE_FIXED;
+		}
+		return operation <= probe->last_op && (probe->ops[operation].flags & IO_URING_OP_SUPPORTED) != 0;
+	};
+	this->m_hasFixedBuffers = this->m_hasFixedBuffers && isSupported(IORING_OP_READ_FIXED) && isSupported(IORING_OP_WRITE_FIXED);
+	if (!this->m_hasFixedBuffers && !(isSupported(IORING_OP_READ) && isSupported(IORING_OP_WRITE)))
+	{
+		this->CloseRing();
+		return false;
+	}
+
+	// the completions are signaled on an event (since Linux 5.2), which Wake signals as well;
+	// without it, the waits only return on completions
+	int wakeupEvent = eventfd(0, EFD_CLOEXEC);
+	if (wakeupEvent >= 0 && syscall(__NR_io_uring_register, ring, IORING_REGISTER_EVENTFD, &wakeupEvent, 1) == 0)
+	{
+		this->m_wakeupEvent = wakeupEvent;
+	}
+	else if (wakeupEvent >= 0)
+	{
+		close(wakeupEvent);
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*private*/ void AsyncIO::CloseRing()
+{
+#ifdef __linux__
+	if (this->m_submissionEntries != nullptr)
+	{
+		munmap(this->m_submissionEntries, this->m_submissionEntriesSize);
+	}
+	if (this->m_completionRing != nullptr && this->m_completionRing != this->m_submissionRing)
+	{
+		munmap(this->m_completionRing, this->m_completionRingSize);
+	}
+	if (this->m_submissionRing != nullptr)
+	{
+		munmap(this->m_submissionRing, this->m_submissionRingSize);
+	}
+	if (this->m_ring >= 0)
+	{
+		close(this->m_ring);
+	}
+	if (this->m_wakeupEvent >= 0)
+	{
+		close(this->m_wakeupEvent);
+	}
+#endif
+	this->m_submissionEntries = this->m_completionRing = this->m_submissionRing = nullptr;
+	this->m_ring = -1;
+	this->m_wakeupEvent = -1;
+}
+
+// queues the (rest of the) request of a buffer, the queued requests are handed to the
+// kernel together by the next EnterRing, i.e. when the caller waits for completions
+/*private*/ void AsyncIO::SubmitToRing(unsigned int bufferNo)
+{
+#ifdef __linux__
+	const Request& request = this->m_requests[bufferNo];
+	byte *address = this->GetBuffer(bufferNo) + request.doneLen;
+
+	// there is at most one request per buffer, so the ring never runs full; the kernel
+	// only reads the tail, the acquire/release pairs order the entry before the tail
+	unsigned int tail = *this->m_sqTail;
+	unsigned int index = tail & *this->m_sqMask;
+	io_uring_sqe *entry = static_cast<io_uring_sqe *>(this->m_submissionEntries) + index;
+	std::memset(entry, 0, sizeof(*entry));
+	if (this->m_hasFixedBuffers)
+	{
+		entry->opcode = request.isWrite ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+		entry->buf_index = static_cast<__u16>(bufferNo);
+	}
+	else
+	{
+		entry->opcode = request.isWrite ? IORING_OP_WRITE : IORING_OP_READ;
+	}
+	entry->fd = request.file;
+	entry->off = request.filePos + request.doneLen;
+	entry->addr = reinterpret_cast<std::uintptr_t>(address);
+	entry->len = static_cast<__u32>(request.len - request.doneLen);
+	entry->user_data = bufferNo;
+	this->m_sqArray[index] = index;
+	__atomic_store_n(this->m_sqTail, tail + 1, __ATOMIC_RELEASE);
+	++this->m_unsubmittedCount;
+#else
+	(void)bufferNo;
+#endif
+}
+
+// hands all queued requests to the kernel with a single system call, which also waits for
+// a completion if [wait] is set; the kernel may take fewer requests than it was given
+/*private*/ void AsyncIO::EnterRing(bool wait)
+{
+#ifdef __linux__
+	while (true)
+	{
+		long result = syscall(__NR_io_uring_enter, this->m_ring, this->m_unsubmittedCount, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+		if (result < 0)
+		{
+			if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			{
+				throw std::runtime_error(std::string("Could not submit or wait for read or write: ") + std::strerror(errno));
+			}
+			continue;
+		}
+
+		this->m_unsubmittedCount -= std::min(this->m_unsubmittedCount, static_cast<unsigned int>(result));
+		if (this->m_unsubmittedCount == 0)
+		{
+			return;
+		}
+	}
+#else
+	(void)wait;
+#endif
+}
+
+// handles all completed requests, if there are none and [wait] is set it waits for one
+/*private*/ void AsyncIO::ReapRing(bool wait)
+{
+#ifdef __linux__
+	while (true)
+	{
+		unsigned int head = *this->m_cqHead;
+		unsigned int tail = __atomic_load_n(this->m_cqTail, __ATOMIC_ACQUIRE);
+		if (head != tail)
+		{
+			for (; head != tail; ++head)
+			{
+				const io_uring_cqe& entry = static_cast<const io_uring_cqe *>(this->m_cqEntries)[head & *this->m_cqMask];
+				unsigned int bufferNo = static_cast<unsigned int>(entry.user_data);
+				long long result = entry.res;
+
+				// the entry is released before it is handled, which may throw
+				__atomic_store_n(this->m_cqHead, head + 1, __ATOMIC_RELEASE);
+				if (!this->Complete(bufferNo, result))
+				{
+					this->SubmitToRing(bufferNo);
+				}
+			}
+			return;
+		}
+
+		if (!wait)
+		{
+			return;
+		}
+		this->EnterRing(true);
+	}
+#else
+	(void)wait;
+#endif
+}
+
+// waits until a completion or Wake signals the wakeup event and resets it
+/*private*/ void AsyncIO::WaitWakeupEvent()
+{
+#ifdef __linux__
+	eventfd_t value = 0;
+	while (eventfd_read(this->m_wakeupEvent, &value) != 0)
+	{
+		if (errno != EINTR)
+		{
+			throw std::runtime_error(std::string("Could not wait for read or write: ") + std::strerror(errno));
+		}
+	}
+#endif
+}
+
+// accounts [result] bytes (or a negative error number) to the request of a buffer
+// and returns true if it is done, false if the rest still has to be transferred
+/*private*/ bool AsyncIO::Complete(unsigned int bufferNo, long long result)
+{
+	Request& request = this->m_requests[bufferNo];
+	if (result <= 0)
+	{
+		request.isPending = false;
+		--this->m_pendingCount;
+		std::string operation = request.isWrite ? "Writing to" : "Reading from";
+		throw std::runtime_error(operation + " file failed: " + (result < 0 ? std::strerror(static_cast<int>(-result)) : "unexpected end of file"));
+	}
+
+	request.doneLen += static_cast<size_t>(result);
+	if (request.doneLen < request.minLen)
+	{
+		return false;
+	}
+
+	request.isPending = false;
+	--this->m_pendingCount;
+	this->m_completions.push_back({ bufferNo, request.isWrite });
+	return true;
+}
+
+/*private*/ void AsyncIO::TransferSynchronously(unsigned int bufferNo)
+{
+#ifndef _WIN32
+	const Request& request = this->m_requests[bufferNo];
+	byte *buffer = this->GetBuffer(bufferNo);
+	bool isDone = false;
+	while (!isDone)
+	{
+		off_t filePos = static_cast<off_t>(request.filePos + request.doneLen);
+		size_t len = request.len - request.doneLen;
+		ssize_t result = request.isWrite
+			? pwrite(request.file, buffer + request.doneLen, len, filePos)
+			: pread(request.file, buffer + request.doneLen, len, filePos);
+		if (result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		isDone = this->Complete(bufferNo, result < 0 ? -static_cast<long long>(errno) : static_cast<long long>(result));
+	}
+#else
+	(void)bufferNo;
+#endif
+}
@@ -0,0 +1,116 @@
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include "TypeDefs.h"
+#include "BufferPool.h"
+
+enum class IOBackend
+{
+	IOUring,
+	PRead
+};
+
+// a read or write that was completely done
+struct IOCompletion
+{
+	unsigned int bufferNo;
+	bool isWrite;
+};
+
+// reads and writes file descriptors through a fixed set of buffers, with one request per
+// buffer in flight at most: the io_uring backend queues the requests and hands all of them to
+// the kernel with a single system call when the caller waits for completions, it registers the
+// buffers with the kernel, so they don't have to be mapped for every request; if io_uring is
+// not available (old kernel without the needed operations, blocked by a sandbox) or the pread
+// backend is chosen,
+// each request is done with pread/pwrite as soon as it is submitted; short reads and writes
+// are continued internally, errors and unexpected ends of file result in an exception
+class AsyncIO
+{
+public:
+	// the buffers are aligned to [BufferAlignment] bytes
+	AsyncIO(IOBackend backend, unsigned int bufferCount, size_t bufferSize);
+	~AsyncIO();
+
+	AsyncIO(const AsyncIO&) = delete;
+	AsyncIO& operator=(const AsyncIO&) = delete;
+
+	byte *GetBuffer(unsigned int bufferNo);
+	size_t GetBufferSize() const;
+	unsigned int GetBufferCount() const;
+	// the backend which is really used
+	IOBackend GetBackend() const;
+
+	// the read is done as soon as [minLen] bytes are there (all [len] bytes if it is 0), so
+	// a read of direct I/O can be rounded up beyond the end of the file
+	void SubmitRead(int file, unsigned int bufferNo, size_t len, unsigned long long filePos, size_t minLen = 0);
+	void SubmitWrite(int file, unsigned int bufferNo, size_t len, unsigned long long filePos);
+
+	// hands the submitted requests to the kernel, waits until at least one request is done
+	// and appends all done requests to [completions]; returns early without completions if
+	// Wake is called meanwhile (or was called since the last wait)
+	void WaitCompletions(std::vector<IOCompletion>& completions);
+	// lets a WaitCompletions of another thread return, so it can submit new requests,
+	// e.g. the writes of buffers which became ready while it was waiting for reads
+	void Wake();
+	// the number of requests which were not returned by WaitCompletions yet
+	unsigned int GetPendingCount() const;
+
+	static const size_t BufferAlignment = BufferPool::PageSize;
+
+private:
+	struct Request
+	{
+		int file = -1;
+		bool isWrite = false;
+		bool isPending = false;
+		size_t len = 0;
+		size_t minLen = 0;
+		size_t doneLen = 0;
+		unsigned long long filePos = 0;
+	};
+
+	IOBackend m_backend;
+	unsigned int m_bufferCount;
+	size_t m_bufferSize;
+	PooledBuffer m_buffers;
+	std::vector<Request> m_requests;
+	std::deque<IOCompletion> m_completions;
+	unsigned int m_pendingCount = 0;
+	unsigned int m_unsubmittedCount = 0;
+
+	// io_uring state, the rings are shared with the kernel; the kernel signals each completion
+	// on the wakeup event, so a wait on the event returns on a completion as well as on Wake
+	int m_ring = -1;
+	int m_wakeupEvent = -1;
+	bool m_hasFixedBuffers = false;
+	void *m_submissionRing = nullptr;
+	size_t m_submissionRingSize = 0;
+	void *m_completionRing = nullptr;
+	size_t m_completionRingSize = 0;
+	void *m_submissionEntries = nullptr;
+	size_t m_submissionEntriesSize = 0;
+	unsigned int *m_sqHead = nullptr;
+	unsigned int *m_sqTail = nullptr;
+	unsigned int *m_sqMask = nullptr;
+	unsigned int *m_sqArray = nullptr;
+	unsigned int *m_cqHead = nullptr;
+	unsigned int *m_cqTail = nullptr;
+	unsigned int *m_cqMask = nullptr;
+	void *m_cqEntries = nullptr;
+
+	void Submit(int file, unsigned int bufferNo, size_t len, size_t minLen, unsigned long long filePos, bool isWrite);
+	bool SetupRing();
+	void CloseRing();
+	void SubmitToRing(unsigned int bufferNo);
+	void EnterRing(bool wait);
+	void ReapRing(bool wait);
+	void WaitWakeupEvent();
+	bool Complete(unsigned int bufferNo, long long result);
+	void TransferSynchronously(unsigned int bufferNo);
+};
+
+#endif
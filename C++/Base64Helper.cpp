@@ -1,11 +1,38 @@
-#include <iostream>
+#include <cstdint>
 #include <stdexcept>
 #include "Base64Helper.h"
+#include "Log.h"
 #include "base64.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_SIMD
+#include <immintrin.h>
+#endif
+
+// the value of every character of the alphabet, -1 for all other characters
+struct Base64DecodeTable
+{
+	signed char values[256];
+
+	constexpr Base64DecodeTable() : values()
+	{
+		const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+		for (int i = 0; i < 256; ++i)
+		{
+			this->values[i] = -1;
+		}
+		for (int i = 0; i < 64; ++i)
+		{
+			this->values[static_cast<unsigned char>(alphabet[i])] = static_cast<signed char>(i);
+		}
+	}
+};
+
+static constexpr Base64DecodeTable decodeTable;
+
 bool Base64Helper::Encode(const std::vector<byte>& data, std::string& output)
 {
-	std::cout << "Base 64 encoding of " << data.size() << " bytes started" << std::endl;
+	LOG_DEBUG("Base 64 encoding of " << data.size() << " bytes started");
 
 	// check if there is data to encode
 	if (data.size() > 0)
@@ -22,11 +49,11 @@ bool Base64Helper::Encode(const std::vector<byte>& data, std::string& output)
 		}
 		catch (const std::exception&)
 		{
-			std::cerr << "Encoding data to base 64 failed" << std::endl;
+			LOG_ERROR("Encoding data to base 64 failed");
 			throw;
 		}
 
-		std::cout << "Base 64 encoding finished" << std::endl;
+		LOG_DEBUG("Base 64 encoding finished");
 		return true;
 	}
 	else
@@ -37,29 +64,180 @@ bool Base64Helper::Encode(const std::vector<byte>& data, std::string& output)
 
 bool Base64Helper::Decode(const std::string& data, std::vector<byte>& output)
 {
-	std::cout << "Base 64 decoding of " << data.size() << " bytes started" << std::endl;
+	LOG_DEBUG("Base 64 decoding of " << data.size() << " bytes started");
 
 	// check if there is data to encode
 	if (data.size() > 0)
 	{
-		try
+		// decode straight into the output vector, which is cut to the decoded size afterwards
+		output.resize(Base64Helper::GetMaxDecodedSize(data.size()));
+		output.resize(Base64Helper::Decode(data.data(), data.size(), output.data()));
+
+		LOG_DEBUG("Base 64 decoding finished");
+		return true;
+	}
+	else
+	{
+		throw std::runtime_error("No data to decode");
+	}
+}
+
+// the vector units decode as much of the data as they can, they stop at the first character
+// outside of the alphabet (e.g. the padding at the end), the rest is decoded one by one
+size_t Base64Helper::Decode(const char *data, size_t len, byte *output)
+{
+	size_t consumedLen = 0;
+	size_t decodedLen = 0;
+#ifdef BASE64_SIMD
+	static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+	static const bool hasSSSE3 = __builtin_cpu_supports("ssse3");
+	if (hasAVX2)
+	{
+		consumedLen = Base64Helper::DecodeAVX2(data, len, output, decodedLen);
+	}
+	else if (hasSSSE3)
+	{
+		consumedLen = Base64Helper::DecodeSSSE3(data, len, output, decodedLen);
+	}
+#endif
+	return decodedLen + Base64Helper::DecodeScalar(data + consumedLen, len - consumedLen, output + decodedLen);
+}
+
+size_t Base64Helper::GetMaxDecodedSize(size_t len)
+{
+	return (len + 3) / 4 * 3;
+}
+
+// whole groups of four characters are decoded at once until one of them holds a character
+// outside of the alphabet, from there on the characters are collected bit by bit and all
+// other characters are skipped
+/*private*/ size_t Base64Helper::DecodeScalar(const char *data, size_t len, byte *output)
+{
+	const unsigned char *input = reinterpret_cast<const unsigned char *>(data);
+	byte *out = output;
+	size_t pos = 0;
+	for (; pos + 4 <= len; pos += 4)
+	{
+		int a = decodeTable.values[input[pos]];
+		int b = decodeTable.values[input[pos + 1]];
+		int c = decodeTable.values[input[pos + 2]];
+		int d = decodeTable.values[input[pos + 3]];
+		if ((a | b | c | d) < 0)
 		{
-			// decode input data with the Crypto++ base 64 decoder
-			std::string out;
-			CryptoPP::StringSource(data, true, new CryptoPP::Base64Decoder(new CryptoPP::StringSink(out)));
-			output = std::vector<byte>(out.begin(), out.end());
+			break;
 		}
-		catch (const std::exception&)
+
+		std::uint32_t bits = static_cast<std::uint32_t>(a) << 18 | static_cast<std::uint32_t>(b) << 12 | static_cast<std::uint32_t>(c) << 6 | static_cast<std::uint32_t>(d);
+		*out++ = static_cast<byte>(bits >> 16);
+		*out++ = static_cast<byte>(bits >> 8);
+		*out++ = static_cast<byte>(bits);
+	}
+
+	std::uint32_t bits = 0;
+	unsigned int bitCount = 0;
+	for (; pos < len; ++pos)
+	{
+		int value = decodeTable.values[input[pos]];
+		if (value < 0)
 		{
-			std::cerr << "Decoding data from base 64 failed" << std::endl;
-			throw;
+			continue;
 		}
 
-		std::cout << "Base 64 decoding finished" << std::endl;
-		return true;
+		bits = (bits << 6 | static_cast<std::uint32_t>(value)) & 0xFFFF;
+		bitCount += 6;
+		if (bitCount >= 8)
+		{
+			bitCount -= 8;
+			*out++ = static_cast<byte>(bits >> bitCount);
+		}
 	}
-	else
+	return static_cast<size_t>(out - output);
+}
+
+#ifdef BASE64_SIMD
+// 16 characters at a time: the characters are validated and translated to their values with
+// lookups by their upper and lower 4 bits, then the 6 bit values are packed to 12 bytes with
+// two multiply-adds and a shuffle; the 16 bytes stored for the 12 bytes always fit, as at
+// least 24 characters are left before each step, which decode to 18 bytes or more
+/*private*/ __attribute__((target("ssse3"))) size_t Base64Helper::DecodeSSSE3(const char *data, size_t len, byte *output, size_t& decodedLen)
+{
+	const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask2F = _mm_set1_epi8(0x2F);
+	const __m128i packPairs = _mm_set1_epi32(0x01400140);
+	const __m128i packQuads = _mm_set1_epi32(0x00011000);
+	const __m128i packBytes = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	size_t pos = 0;
+	decodedLen = 0;
+	while (len - pos >= 24)
 	{
-		throw std::runtime_error("No data to decode");
+		__m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+		__m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(input, 4), mask2F);
+		__m128i loNibbles = _mm_and_si128(input, mask2F);
+		__m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+		__m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+		if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+		{
+			break;
+		}
+
+		__m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(input, mask2F), hiNibbles));
+		__m128i values = _mm_add_epi8(input, roll);
+		__m128i packed = _mm_madd_epi16(_mm_maddubs_epi16(values, packPairs), packQuads);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(output + decodedLen), _mm_shuffle_epi8(packed, packBytes));
+
+		pos += 16;
+		decodedLen += 12;
 	}
-}
\ No newline at end of file
+	return pos;
+}
+
+// the same as with SSSE3 for 32 characters, the 12 bytes of both halves are moved next to each
+// other at the end; at least 48 characters (36 bytes) are left for the 32 bytes stored
+/*private*/ __attribute__((target("avx2"))) size_t Base64Helper::DecodeAVX2(const char *data, size_t len, byte *output, size_t& decodedLen)
+{
+	const __m256i lutLo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const __m256i lutHi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lutRoll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i mask2F = _mm256_set1_epi8(0x2F);
+	const __m256i packPairs = _mm256_set1_epi32(0x01400140);
+	const __m256i packQuads = _mm256_set1_epi32(0x00011000);
+	const __m256i packBytes = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	const __m256i packLanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+	size_t pos = 0;
+	decodedLen = 0;
+	while (len - pos >= 48)
+	{
+		__m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+		__m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(input, 4), mask2F);
+		__m256i loNibbles = _mm256_and_si256(input, mask2F);
+		__m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+		__m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+		if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256())) != 0)
+		{
+			break;
+		}
+
+		__m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(input, mask2F), hiNibbles));
+		__m256i values = _mm256_add_epi8(input, roll);
+		__m256i packed = _mm256_madd_epi16(_mm256_maddubs_epi16(values, packPairs), packQuads);
+		packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(packed, packBytes), packLanes);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(output + decodedLen), packed);
+
+		pos += 32;
+		decodedLen += 24;
+	}
+	return pos;
+}
+#endif
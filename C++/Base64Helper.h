@@ -1,6 +1,7 @@
 #ifndef BASE64HELPER_H
 #define BASE64HELPER_H
 
+#include <cstddef>
 #include <string>
 #include <vector>
 #include "TypeDefs.h"
@@ -12,6 +13,19 @@ public:
 
 	static bool Encode(const std::vector<byte>& data, std::string& output);
 	static bool Decode(const std::string& data, std::vector<byte>& output);
+
+	// decodes [len] characters straight into [output], which must hold at least
+	// GetMaxDecodedSize(len) bytes, and returns the number of decoded bytes; like the
+	// Crypto++ decoder, characters outside of the alphabet (line breaks, padding) are skipped
+	static size_t Decode(const char *data, size_t len, byte *output);
+	static size_t GetMaxDecodedSize(size_t len);
+
+private:
+	static size_t DecodeScalar(const char *data, size_t len, byte *output);
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	static size_t DecodeSSSE3(const char *data, size_t len, byte *output, size_t& decodedLen);
+	static size_t DecodeAVX2(const char *data, size_t len, byte *output, size_t& decodedLen);
+#endif
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,231 @@
+#include "BatchDecryptor.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include "Base64Helper.h"
+#include "ProgressReporter.h"
+#include "RunStatistics.h"
+#include "Log.h"
+
+BatchDecryptor::BatchDecryptor(unsigned int threadCount, size_t maxPendingFiles, size_t rangeSize /* = DefaultRangeSize*/)
+	: m_maxPendingFiles(std::max<size_t>(maxPendingFiles, 1)), m_rangeSize(rangeSize), m_pool(threadCount)
+{
+	this->m_workerDecryptors.resize(this->m_pool.GetThreadCount());
+}
+
+void BatchDecryptor::Add(const EncryptedFileEntry& entry, UnwrappedFile& unwrappedFile, bool createOutputDirectory)
+{
+	{
+		std::unique_lock<std::mutex> lock(this->m_mutex);
+		this->m_fileDone.wait(lock, [this] { return this->m_pendingFiles < this->m_maxPendingFiles; });
+		++this->m_pendingFiles;
+	}
+
+	std::shared_ptr<PendingFile> file(new PendingFile());
+	file->fileNo = ++this->m_addedFiles;
+	file->encryptedFilePath = entry.encryptedFilePath;
+	bool isOutputCreated = false;
+	try
+	{
+		if (unwrappedFile.error)
+		{
+			std::rethrow_exception(unwrappedFile.error);
+		}
+		FileData& fileData = *unwrappedFile.fileData;
+		file->encryptedFile = std::move(unwrappedFile.encryptedFile);
+		file->fileCryptoKey = unwrappedFile.fileCryptoKey;
+		file->blockSize = fileData.GetBlockSize();
+		file->offset = fileData.GetHeaderLen();
+		file->isPadded = fileData.GetCipherPadding() > 0;
+		file->bodySize = file->encryptedFile->GetSize() > file->offset ? file->encryptedFile->GetSize() - file->offset : 0;
+		if (file->fileCryptoKey.empty() || file->blockSize == 0)
+		{
+			throw std::runtime_error("Crypto key for file can't be empty and block size must be bigger than zero");
+		}
+
+		// IVec in file header is base 64 encoded, the IVecs
+		// of the single blocks are derived from it
+		std::vector<byte> decodedFileIV;
+		Base64Helper::Decode(fileData.GetBaseIVec(), decodedFileIV);
+		file->blockIVGenerator.reset(new BlockIVGenerator(decodedFileIV, file->fileCryptoKey));
+
+		// the output paths are only derived here, one file after the other, so two
+		// files can't end up with the same output path if their names collide
+		fileData.SetOutputFilepath(entry.outputFilePath);
+		file->outputFilePath = fileData.GetOutputFilepath();
+		std::string outputDirectory = std::filesystem::path(file->outputFilePath).parent_path().string();
+		if (createOutputDirectory && outputDirectory.length() > 0)
+		{
+			std::filesystem::create_directories(outputDirectory);
+		}
+
+		StageTimer timer(Stage::Write);
+		isOutputCreated = true;
+		file->outputFile.reset(new OutputFile(file->outputFilePath, file->bodySize));
+		ProgressReporter::Get().StartFile(file->bodySize);
+	}
+	catch (const std::exception&)
+	{
+		// don't leave a partially decrypted file behind
+		if (isOutputCreated)
+		{
+			std::remove(file->outputFilePath.c_str());
+		}
+		this->ReportFile(file->encryptedFilePath, file->outputFilePath, std::current_exception());
+		this->ReleaseFile();
+		return;
+	}
+
+	// the ranges are whole blocks, as each block is decrypted with its own IVec
+	// (which only depends on the block number) they can be decrypted in any order
+	size_t rangeBlocks = std::max<size_t>(this->m_rangeSize / file->blockSize, 1);
+	size_t rangeLen = rangeBlocks * file->blockSize;
+	size_t rangeCount = (file->bodySize + rangeLen - 1) / rangeLen;
+	if (rangeCount == 0)
+	{
+		this->FinishFile(*file);
+		return;
+	}
+
+	file->encryptedFile->AdviseSequential(file->offset, file->encryptedFile->GetSize());
+	file->remainingRanges = rangeCount;
+	std::vector<WorkStealingPool::Task> tasks;
+	tasks.reserve(rangeCount);
+	for (size_t rangeNo = 0; rangeNo < rangeCount; ++rangeNo)
+	{
+		tasks.push_back([this, file, rangeNo, rangeBlocks, rangeLen](unsigned int workerNo)
+		{
+			size_t rangePos = rangeNo * rangeLen;
+			this->DecryptRange(*file, rangeNo * rangeBlocks, std::min(rangeLen, file->bodySize - rangePos), workerNo);
+			if (--file->remainingRanges == 0)
+			{
+				this->FinishFile(*file);
+			}
+		});
+	}
+	this->m_pool.Submit(tasks);
+}
+
+size_t BatchDecryptor::Finish()
+{
+	this->m_pool.Wait();
+
+	std::lock_guard<std::mutex> lock(this->m_mutex);
+	return this->m_failedFiles;
+}
+
+// decrypts [len] bytes of blocks starting with block [firstBlockNo], the last block of the
+// file may be shorter than the block size and has a PKCS7 padding if a cipher padding size
+// greater than 0 was specified in file header; the decryptor of the worker is only rekeyed
+// if its last range belonged to another file, so the ranges of a file share the key schedule
+/*private*/ void BatchDecryptor::DecryptRange(PendingFile& file, unsigned long long firstBlockNo, size_t len, unsigned int workerNo)
+{
+	{
+		// the other ranges of a file that failed are skipped
+		std::lock_guard<std::mutex> lock(file.errorMutex);
+		if (file.error)
+		{
+			return;
+		}
+	}
+
+	try
+	{
+		size_t rangePos = static_cast<size_t>(firstBlockNo * file.blockSize);
+		bool isLastRange = rangePos + len == file.bodySize;
+		const byte *ciphertext = file.encryptedFile->GetData() + file.offset + rangePos;
+		byte *plaintext = file.outputFile->GetData() + rangePos;
+
+		WorkerDecryptor& workerDecryptor = this->m_workerDecryptors[workerNo];
+		if (!workerDecryptor.blockDecryptor)
+		{
+			workerDecryptor.blockDecryptor.reset(new FileBlockDecryptor(file.fileCryptoKey, *file.blockIVGenerator));
+		}
+		else if (workerDecryptor.fileNo != file.fileNo)
+		{
+			workerDecryptor.blockDecryptor->SetKey(file.fileCryptoKey, *file.blockIVGenerator);
+		}
+		workerDecryptor.fileNo = file.fileNo;
+		size_t plaintextLen = workerDecryptor.blockDecryptor->DecryptBlocks(firstBlockNo, ciphertext, plaintext, len, file.blockSize, isLastRange && file.isPadded);
+		if (isLastRange)
+		{
+			file.paddingLen = len - plaintextLen;
+		}
+		RunStatistics::Get().AddData(len, plaintextLen, (len + file.blockSize - 1) / file.blockSize);
+		ProgressReporter::Get().AddData(len, (len + file.blockSize - 1) / file.blockSize);
+	}
+	catch (const std::exception&)
+	{
+		std::lock_guard<std::mutex> lock(file.errorMutex);
+		if (!file.error)
+		{
+			file.error = std::current_exception();
+		}
+	}
+}
+
+// cuts off the padding and closes the files once all ranges of a file are done
+/*private*/ void BatchDecryptor::FinishFile(PendingFile& file)
+{
+	std::exception_ptr error;
+	{
+		std::lock_guard<std::mutex> lock(file.errorMutex);
+		error = file.error;
+	}
+
+	if (!error)
+	{
+		try
+		{
+			StageTimer timer(Stage::Write);
+			file.outputFile->Close(file.bodySize - file.paddingLen);
+		}
+		catch (const std::exception&)
+		{
+			error = std::current_exception();
+		}
+	}
+	file.outputFile.reset();
+	file.encryptedFile.reset();
+
+	// don't leave a partially decrypted file behind
+	if (error)
+	{
+		std::remove(file.outputFilePath.c_str());
+	}
+	this->ReportFile(file.encryptedFilePath, file.outputFilePath, error);
+	this->ReleaseFile();
+}
+
+/*private*/ void BatchDecryptor::ReportFile(const std::string& encryptedFilePath, const std::string& outputFilePath, std::exception_ptr error)
+{
+	RunStatistics::Get().AddFile(!error);
+	ProgressReporter::Get().FinishFile();
+
+	std::lock_guard<std::mutex> lock(this->m_mutex);
+	if (!error)
+	{
+		LOG_INFO("Successfully decrypted file '" << encryptedFilePath << "', output: '" << outputFilePath << "'");
+		return;
+	}
+
+	++this->m_failedFiles;
+	try
+	{
+		std::rethrow_exception(error);
+	}
+	catch (const std::exception& e)
+	{
+		LOG_ERROR("Decryption of file '" << encryptedFilePath << "' failed: " << e.what());
+	}
+}
+
+/*private*/ void BatchDecryptor::ReleaseFile()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		--this->m_pendingFiles;
+	}
+	this->m_fileDone.notify_all();
+}
@@ -0,0 +1,89 @@
+#ifndef BATCHDECRYPTOR_H
+#define BATCHDECRYPTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "BlockIVGenerator.h"
+#include "FileBlockDecryptor.h"
+#include "FileCollector.h"
+#include "FileKeyUnwrapper.h"
+#include "OutputFile.h"
+#include "WorkStealingPool.h"
+
+// decrypts the files of a batch run at the same time instead of one after the other: every
+// file is split into ranges of blocks of about [rangeSize] bytes, which are decrypted from the
+// mapped encrypted file straight into the mapped output file, so a small file is a single task
+// and a big one many tasks, which idle threads steal while the small files go on; a file is
+// closed (or removed, if one of its ranges failed) by the thread that decrypts its last range,
+// at most [maxPendingFiles] files are decrypted at once
+class BatchDecryptor
+{
+public:
+	BatchDecryptor(unsigned int threadCount, size_t maxPendingFiles, size_t rangeSize = DefaultRangeSize);
+
+	BatchDecryptor(const BatchDecryptor&) = delete;
+	BatchDecryptor& operator=(const BatchDecryptor&) = delete;
+
+	// creates the output file and schedules the ranges of an unwrapped file, waits while there
+	// are too many files pending; the files must be added in the order of the run, as their
+	// output paths are derived here; a file which fails here is reported right away
+	void Add(const EncryptedFileEntry& entry, UnwrappedFile& unwrappedFile, bool createOutputDirectory);
+
+	// waits until all added files are done and returns the number of files which failed
+	size_t Finish();
+
+	static const size_t DefaultRangeSize = 4 * 1024 * 1024;
+
+private:
+	struct PendingFile
+	{
+		// identifies the file of the run (the address of the object may be reused)
+		unsigned long long fileNo = 0;
+		std::string encryptedFilePath;
+		std::string outputFilePath;
+		std::unique_ptr<MappedFile> encryptedFile;
+		std::vector<byte> fileCryptoKey;
+		std::unique_ptr<BlockIVGenerator> blockIVGenerator;
+		std::unique_ptr<OutputFile> outputFile;
+		unsigned int blockSize = 0;
+		unsigned int offset = 0;
+		bool isPadded = false;
+		size_t bodySize = 0;
+		std::atomic<size_t> remainingRanges{ 0 };
+		std::atomic<size_t> paddingLen{ 0 };
+		std::mutex errorMutex;
+		std::exception_ptr error;
+	};
+
+	// every worker keeps its decryptor and only gives it another key
+	// (and IVec generator) when it moves on to a range of another file
+	struct WorkerDecryptor
+	{
+		std::unique_ptr<FileBlockDecryptor> blockDecryptor;
+		unsigned long long fileNo = 0;
+	};
+
+	size_t m_maxPendingFiles;
+	size_t m_rangeSize;
+	std::mutex m_mutex;
+	std::condition_variable m_fileDone;
+	size_t m_pendingFiles = 0;
+	size_t m_failedFiles = 0;
+	unsigned long long m_addedFiles = 0;
+	std::vector<WorkerDecryptor> m_workerDecryptors;
+	// destroyed first, so the tasks which are still running can use the members above
+	WorkStealingPool m_pool;
+
+	void DecryptRange(PendingFile& file, unsigned long long firstBlockNo, size_t len, unsigned int workerNo);
+	void FinishFile(PendingFile& file);
+	void ReportFile(const std::string& encryptedFilePath, const std::string& outputFilePath, std::exception_ptr error);
+	void ReleaseFile();
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include "BlockCache.h"
+#include <stdexcept>
+#include "HeaderIndex.h"
+
+BlockCache::BlockCache(size_t maxBytes, unsigned int shardCount /* = DefaultShardCount*/)
+	: m_maxBytes(maxBytes)
+{
+	if (shardCount == 0)
+	{
+		throw std::runtime_error("Block cache needs at least one shard");
+	}
+
+	for (unsigned int shardNo = 0; shardNo < shardCount; ++shardNo)
+	{
+		this->m_shards.emplace_back(new Shard());
+	}
+}
+
+unsigned long long BlockCache::GetFileId(const std::string& filePath, unsigned long long fileSize)
+{
+	std::string fileIdentity = filePath + '\0' + std::to_string(fileSize) + '\0' + std::to_string(HeaderIndex::GetModificationTime(filePath));
+
+	std::lock_guard<std::mutex> lock(this->m_fileIdMutex);
+	return this->m_fileIds.emplace(fileIdentity, this->m_fileIds.size()).first->second;
+}
+
+BlockCache::Block BlockCache::Find(unsigned long long fileId, unsigned long long blockNo)
+{
+	BlockKey key = { fileId, blockNo };
+	Shard& shard = *this->m_shards[this->GetShardNo(key)];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	auto it = shard.index.find(key);
+	if (it == shard.index.end())
+	{
+		++this->m_misses;
+		return nullptr;
+	}
+
+	++this->m_hits;
+	it->second->lastUse = ++this->m_useClock;
+	shard.blocks.splice(shard.blocks.begin(), shard.blocks, it->second);
+	return it->second->block;
+}
+
+void BlockCache::Insert(unsigned long long fileId, unsigned long long blockNo, Block block)
+{
+	// a block which doesn't fit at all would only push out all others
+	size_t cost = BlockCache::GetBlockCost(block);
+	if (block == nullptr || cost > this->m_maxBytes)
+	{
+		return;
+	}
+
+	// the room for the block is made before it is added, so the cached blocks never take
+	// more than the limit, not even while other threads add blocks at the same time
+	if (!this->ReserveBytes(cost))
+	{
+		return;
+	}
+
+	BlockKey key = { fileId, blockNo };
+	Shard& shard = *this->m_shards[this->GetShardNo(key)];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	auto it = shard.index.find(key);
+	if (it != shard.index.end())
+	{
+		this->m_usedBytes -= BlockCache::GetBlockCost(it->second->block);
+		it->second->block = std::move(block);
+		it->second->lastUse = ++this->m_useClock;
+		shard.blocks.splice(shard.blocks.begin(), shard.blocks, it->second);
+	}
+	else
+	{
+		shard.blocks.push_front({ key, std::move(block), ++this->m_useClock });
+		shard.index.emplace(key, shard.blocks.begin());
+	}
+}
+
+BlockCacheStatistics BlockCache::GetStatistics() const
+{
+	BlockCacheStatistics statistics;
+	statistics.hits = this->m_hits;
+	statistics.misses = this->m_misses;
+	statistics.evictions = this->m_evictions;
+	statistics.usedBytes = this->m_usedBytes;
+	return statistics;
+}
+
+/*private*/ size_t BlockCache::BlockKeyHash::operator()(const BlockKey& key) const
+{
+	// consecutive blocks of a file end up in different shards
+	unsigned long long hash = key.fileId * 0x9e3779b97f4a7c15ULL ^ key.blockNo;
+	hash ^= hash >> 29;
+	hash *= 0xbf58476d1ce4e5b9ULL;
+	hash ^= hash >> 32;
+	return static_cast<size_t>(hash);
+}
+
+/*private*/ size_t BlockCache::GetShardNo(const BlockKey& key) const
+{
+	return BlockKeyHash()(key) % this->m_shards.size();
+}
+
+// evicts the least recently used blocks until [bytes] more fit into the limit and adds them
+// to the used bytes; false if there is nothing left to evict, which only happens while the
+// room is taken by blocks other threads are adding right now
+/*private*/ bool BlockCache::ReserveBytes(size_t bytes)
+{
+	unsigned long long usedBytes = this->m_usedBytes;
+	while (true)
+	{
+		if (usedBytes + bytes <= this->m_maxBytes)
+		{
+			if (this->m_usedBytes.compare_exchange_weak(usedBytes, usedBytes + bytes))
+			{
+				return true;
+			}
+			continue;
+		}
+
+		if (!this->EvictOldest())
+		{
+			return false;
+		}
+		usedBytes = this->m_usedBytes;
+	}
+}
+
+// evicts the least recently used block: the oldest block of each shard is at the end of its
+// list, the oldest of these is evicted; only one shard is locked at a time, so another thread
+// may use a block in between, which only makes the choice a bit less exact; false if all
+// shards are empty
+/*private*/ bool BlockCache::EvictOldest()
+{
+	size_t oldestShardNo = this->m_shards.size();
+	unsigned long long oldestUse = 0;
+	for (size_t shardNo = 0; shardNo < this->m_shards.size(); ++shardNo)
+	{
+		Shard& shard = *this->m_shards[shardNo];
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		if (!shard.blocks.empty() && (oldestShardNo == this->m_shards.size() || shard.blocks.back().lastUse < oldestUse))
+		{
+			oldestShardNo = shardNo;
+			oldestUse = shard.blocks.back().lastUse;
+		}
+	}
+	if (oldestShardNo == this->m_shards.size())
+	{
+		return false;
+	}
+
+	Shard& shard = *this->m_shards[oldestShardNo];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	if (!shard.blocks.empty())
+	{
+		this->m_usedBytes -= BlockCache::GetBlockCost(shard.blocks.back().block);
+		shard.index.erase(shard.blocks.back().key);
+		shard.blocks.pop_back();
+		++this->m_evictions;
+	}
+	return true;
+}
+
+// the plaintext and a rough estimate of the bookkeeping per block
+/*private*/ size_t BlockCache::GetBlockCost(const Block& block)
+{
+	return (block != nullptr ? block->size() : 0) + 128;
+}
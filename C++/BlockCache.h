@@ -0,0 +1,97 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "TypeDefs.h"
+
+struct BlockCacheStatistics
+{
+	unsigned long long hits = 0;
+	unsigned long long misses = 0;
+	unsigned long long evictions = 0;
+	unsigned long long usedBytes = 0;
+};
+
+// keeps decrypted file blocks in memory, so blocks which are read again and again don't have
+// to be decrypted each time; the blocks are distributed over shards with their own lock and
+// LRU list, so several threads can use the cache at once, while the memory limit applies to
+// all blocks of all files together: the block evicted is the least recently used one of all
+// shards; blocks are handed out as shared pointers, which stay
+// valid after the block was evicted
+class BlockCache
+{
+public:
+	using Block = std::shared_ptr<const std::vector<byte>>;
+
+	explicit BlockCache(size_t maxBytes, unsigned int shardCount = DefaultShardCount);
+
+	BlockCache(const BlockCache&) = delete;
+	BlockCache& operator=(const BlockCache&) = delete;
+
+	// the id of a file is bound to its path, size and modification time,
+	// so a changed file gets a new id and none of the old blocks
+	unsigned long long GetFileId(const std::string& filePath, unsigned long long fileSize);
+
+	// returns nullptr if the block is not in the cache
+	Block Find(unsigned long long fileId, unsigned long long blockNo);
+	void Insert(unsigned long long fileId, unsigned long long blockNo, Block block);
+
+	BlockCacheStatistics GetStatistics() const;
+
+	static const unsigned int DefaultShardCount = 16;
+
+private:
+	struct BlockKey
+	{
+		unsigned long long fileId;
+		unsigned long long blockNo;
+
+		bool operator==(const BlockKey& other) const { return fileId == other.fileId && blockNo == other.blockNo; }
+	};
+
+	struct BlockKeyHash
+	{
+		size_t operator()(const BlockKey& key) const;
+	};
+
+	struct Entry
+	{
+		BlockKey key;
+		Block block;
+		unsigned long long lastUse;
+	};
+
+	// the most recently used block is at the front of the list
+	struct Shard
+	{
+		std::mutex mutex;
+		std::list<Entry> blocks;
+		std::unordered_map<BlockKey, std::list<Entry>::iterator, BlockKeyHash> index;
+	};
+
+	size_t m_maxBytes;
+	std::vector<std::unique_ptr<Shard>> m_shards;
+	std::atomic<unsigned long long> m_usedBytes{ 0 };
+	std::atomic<unsigned long long> m_useClock{ 0 };
+	std::atomic<unsigned long long> m_hits{ 0 };
+	std::atomic<unsigned long long> m_misses{ 0 };
+	std::atomic<unsigned long long> m_evictions{ 0 };
+
+	std::mutex m_fileIdMutex;
+	std::map<std::string, unsigned long long> m_fileIds;
+
+	size_t GetShardNo(const BlockKey& key) const;
+	bool ReserveBytes(size_t bytes);
+	bool EvictOldest();
+	static size_t GetBlockCost(const Block& block);
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "BlockIVGenerator.h"
+#include <cstring>
+#include <stdexcept>
+#include "secblock.h"
+
+BlockIVGenerator::BlockIVGenerator(const std::vector<byte>& baseIVec, const std::vector<byte>& key)
+	: m_ivecSize(baseIVec.size())
+{
+	if (baseIVec.size() > 0 && baseIVec.size() <= MaxIVecSize && key.size() > 0)
+	{
+		std::memcpy(this->m_baseIVec, baseIVec.data(), baseIVec.size());
+
+		// keys longer than the block size of the hash are hashed first,
+		// shorter ones are padded with zeros (see RFC 2104)
+		CryptoPP::FixedSizeSecBlock<byte, CryptoPP::SHA256::BLOCKSIZE> keyBlock;
+		std::memset(keyBlock, 0, keyBlock.size());
+		if (key.size() > keyBlock.size())
+		{
+			CryptoPP::SHA256().CalculateDigest(keyBlock, key.data(), key.size());
+		}
+		else
+		{
+			std::memcpy(keyBlock, key.data(), key.size());
+		}
+
+		// absorb the inner and outer padded key once,
+		// these states are the starting point for every block
+		for (size_t i = 0; i < keyBlock.size(); ++i)
+		{
+			keyBlock[i] ^= 0x36;
+		}
+		this->m_innerHash.Update(keyBlock, keyBlock.size());
+
+		for (size_t i = 0; i < keyBlock.size(); ++i)
+		{
+			keyBlock[i] ^= 0x36 ^ 0x5c;
+		}
+		this->m_outerHash.Update(keyBlock, keyBlock.size());
+	}
+	else
+	{
+		throw std::runtime_error("Base initialization vector and crypto key can't be empty and the initialization vector can't be longer than 32 bytes");
+	}
+}
+
+// from https://github.com/vgough/encfs/blob/559c30d01ed0a3d19258b12f15eae8785accc60f/encfs/SSL_Cipher.cpp#L626
+void BlockIVGenerator::ComputeBlockIVec(unsigned long long blockNo, byte *blockIVec) const
+{
+	// the hashed message is the base IVec followed by the block number (little endian, 8 bytes)
+	byte message[MaxIVecSize + 8];
+	std::memcpy(message, this->m_baseIVec, this->m_ivecSize);
+	for (size_t i = 0; i < 8; ++i)
+	{
+		message[this->m_ivecSize + i] = static_cast<byte>(blockNo & 0xff);
+		blockNo >>= 8;
+	}
+
+	// the copies of the precomputed states live on the stack
+	byte innerDigest[CryptoPP::SHA256::DIGESTSIZE];
+	CryptoPP::SHA256 hash(this->m_innerHash);
+	hash.Update(message, this->m_ivecSize + 8);
+	hash.Final(innerDigest);
+
+	// the IVec consists of the first bytes of the HMAC
+	hash = this->m_outerHash;
+	hash.Update(innerDigest, sizeof(innerDigest));
+	hash.TruncatedFinal(blockIVec, this->m_ivecSize);
+}
+
+size_t BlockIVGenerator::GetIVecSize() const
+{
+	return this->m_ivecSize;
+}
@@ -0,0 +1,33 @@
+#ifndef BLOCKIVGENERATOR_H
+#define BLOCKIVGENERATOR_H
+
+#include <vector>
+#include "TypeDefs.h"
+#include "sha.h"
+
+// derives the initialization vector of each file block from the base IVec in the file
+// header, the block number and the file key via HMAC-SHA-256; the key schedule of the
+// HMAC is only computed once per file, for each block the precomputed inner and outer
+// hash states are copied, so there is no memory allocation per block
+class BlockIVGenerator
+{
+public:
+	BlockIVGenerator(const std::vector<byte>& baseIVec, const std::vector<byte>& key);
+
+	BlockIVGenerator(const BlockIVGenerator&) = delete;
+	BlockIVGenerator& operator=(const BlockIVGenerator&) = delete;
+
+	// can be called from several threads at once, [blockIVec] must hold GetIVecSize() bytes
+	void ComputeBlockIVec(unsigned long long blockNo, byte *blockIVec) const;
+	size_t GetIVecSize() const;
+
+	static const size_t MaxIVecSize = CryptoPP::SHA256::DIGESTSIZE;
+
+private:
+	CryptoPP::SHA256 m_innerHash;
+	CryptoPP::SHA256 m_outerHash;
+	byte m_baseIVec[MaxIVecSize];
+	size_t m_ivecSize;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// a ring buffer of at most [capacity] items between the threads of two stages of a pipeline:
+// a producer blocks while it is full and a consumer while it is empty, so a fast stage can't
+// run away from a slow one; Close ends the stream of items once it is drained, Abort ends it
+// right away (after an error in some stage), so no thread stays blocked in the queue
+template <typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity)
+		: m_items(capacity)
+	{
+		if (capacity == 0)
+		{
+			throw std::runtime_error("Capacity of queue must be bigger than zero");
+		}
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	// returns false if the queue was closed or aborted, the item is dropped then
+	bool Push(T item)
+	{
+		std::unique_lock<std::mutex> lock(this->m_mutex);
+		this->m_notFull.wait(lock, [this] { return this->m_count < this->m_items.size() || this->m_isClosed || this->m_isAborted; });
+		if (this->m_isClosed || this->m_isAborted)
+		{
+			return false;
+		}
+
+		this->m_items[(this->m_head + this->m_count) % this->m_items.size()] = std::move(item);
+		++this->m_count;
+		lock.unlock();
+		this->m_notEmpty.notify_one();
+		return true;
+	}
+
+	// returns false if the queue was aborted or closed and all items were taken
+	bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(this->m_mutex);
+		this->m_notEmpty.wait(lock, [this] { return this->m_count > 0 || this->m_isClosed || this->m_isAborted; });
+		if (this->m_isAborted || this->m_count == 0)
+		{
+			return false;
+		}
+
+		item = std::move(this->m_items[this->m_head]);
+		this->m_head = (this->m_head + 1) % this->m_items.size();
+		--this->m_count;
+		lock.unlock();
+		this->m_notFull.notify_one();
+		return true;
+	}
+
+	// same as Pop, but returns false right away instead of waiting if the queue is empty
+	bool TryPop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(this->m_mutex);
+		if (this->m_isAborted || this->m_count == 0)
+		{
+			return false;
+		}
+
+		item = std::move(this->m_items[this->m_head]);
+		this->m_head = (this->m_head + 1) % this->m_items.size();
+		--this->m_count;
+		lock.unlock();
+		this->m_notFull.notify_one();
+		return true;
+	}
+
+	void Close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->m_mutex);
+			this->m_isClosed = true;
+		}
+		this->m_notEmpty.notify_all();
+		this->m_notFull.notify_all();
+	}
+
+	void Abort()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->m_mutex);
+			this->m_isAborted = true;
+		}
+		this->m_notEmpty.notify_all();
+		this->m_notFull.notify_all();
+	}
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_notFull;
+	std::condition_variable m_notEmpty;
+	std::vector<T> m_items;
+	size_t m_head = 0;
+	size_t m_count = 0;
+	bool m_isClosed = false;
+	bool m_isAborted = false;
+};
+
+#endif
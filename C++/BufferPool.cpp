@@ -0,0 +1,241 @@
+#include "BufferPool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+PooledBuffer::PooledBuffer(byte *data, size_t size, BufferPool *pool)
+	: m_data(data), m_size(size), m_pool(pool)
+{
+}
+
+PooledBuffer::~PooledBuffer()
+{
+	this->Release();
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept
+	: m_data(other.m_data), m_size(other.m_size), m_pool(other.m_pool)
+{
+	other.m_data = nullptr;
+	other.m_size = 0;
+	other.m_pool = nullptr;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept
+{
+	if (this != &other)
+	{
+		this->Release();
+		std::swap(this->m_data, other.m_data);
+		std::swap(this->m_size, other.m_size);
+		std::swap(this->m_pool, other.m_pool);
+	}
+	return *this;
+}
+
+byte *PooledBuffer::GetData() const
+{
+	return this->m_data;
+}
+
+size_t PooledBuffer::GetSize() const
+{
+	return this->m_size;
+}
+
+void PooledBuffer::Release()
+{
+	if (this->m_pool != nullptr)
+	{
+		this->m_pool->Release(this->m_data, this->m_size);
+	}
+	this->m_data = nullptr;
+	this->m_size = 0;
+	this->m_pool = nullptr;
+}
+
+BufferPool::~BufferPool()
+{
+	for (const auto& allocation : this->m_allocations)
+	{
+		BufferPool::Free(allocation.first, allocation.second);
+	}
+}
+
+BufferPool& BufferPool::Get()
+{
+	static BufferPool pool;
+	return pool;
+}
+
+PooledBuffer BufferPool::Acquire(size_t size)
+{
+	if (size == 0)
+	{
+		return PooledBuffer();
+	}
+
+	std::lock_guard<std::mutex> lock(this->m_mutex);
+	size_t sizeClass = BufferPool::GetSizeClass(size, this->m_useHugePages);
+	std::vector<byte *>& freeBuffers = this->m_freeBuffers[sizeClass];
+	++this->m_statistics.acquisitions;
+
+	byte *data = nullptr;
+	if (!freeBuffers.empty())
+	{
+		data = freeBuffers.back();
+		freeBuffers.pop_back();
+		this->m_freeBytes -= sizeClass;
+		++this->m_statistics.reuses;
+	}
+	else
+	{
+		Allocation allocation;
+		data = this->Allocate(sizeClass, allocation);
+		this->m_allocations[data] = allocation;
+		++this->m_statistics.allocations;
+		this->m_statistics.reservedBytes += sizeClass;
+		this->m_statistics.hugePageBytes += allocation.isHugePages ? sizeClass : 0;
+	}
+
+	this->m_statistics.usedBytes += sizeClass;
+	this->m_statistics.peakUsedBytes = std::max(this->m_statistics.peakUsedBytes, this->m_statistics.usedBytes);
+	return PooledBuffer(data, sizeClass, this);
+}
+
+void BufferPool::SetHugePages(bool useHugePages)
+{
+	std::lock_guard<std::mutex> lock(this->m_mutex);
+	this->m_useHugePages = useHugePages;
+}
+
+void BufferPool::SetMaxFreeBytes(size_t maxFreeBytes)
+{
+	std::lock_guard<std::mutex> lock(this->m_mutex);
+	this->m_maxFreeBytes = maxFreeBytes;
+}
+
+BufferPoolStatistics BufferPool::GetStatistics() const
+{
+	std::lock_guard<std::mutex> lock(this->m_mutex);
+	return this->m_statistics;
+}
+
+// the buffer is freed without holding the lock, as unmapping it may take a while
+/*private*/ void BufferPool::Release(byte *data, size_t size)
+{
+	Allocation allocation;
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		this->m_statistics.usedBytes -= size;
+		if (this->m_freeBytes + size <= this->m_maxFreeBytes)
+		{
+			this->m_freeBuffers[size].push_back(data);
+			this->m_freeBytes += size;
+			return;
+		}
+
+		auto allocationIt = this->m_allocations.find(data);
+		allocation = allocationIt->second;
+		this->m_allocations.erase(allocationIt);
+		this->m_statistics.reservedBytes -= size;
+		this->m_statistics.hugePageBytes -= allocation.isHugePages ? size : 0;
+		this->m_statistics.freedBytes += size;
+	}
+	BufferPool::Free(data, allocation);
+}
+
+// small buffers come from the heap, buffers of a page or more are mapped directly,
+// so they are page aligned and can be backed by huge pages
+/*private*/ byte *BufferPool::Allocate(size_t size, Allocation& allocation)
+{
+	allocation.isMapped = false;
+	allocation.isHugePages = false;
+	void *data = nullptr;
+
+#ifdef _WIN32
+	data = _aligned_malloc(size, size >= BufferPool::PageSize ? BufferPool::PageSize : BufferPool::CacheLineSize);
+#else
+	if (size < BufferPool::PageSize)
+	{
+		if (posix_memalign(&data, BufferPool::CacheLineSize, size) != 0)
+		{
+			data = nullptr;
+		}
+	}
+	else
+	{
+		bool isHugePageSize = size % BufferPool::HugePageSize == 0;
+#ifdef MAP_HUGETLB
+		// reserved huge pages are used if there are enough of them ...
+		if (isHugePageSize)
+		{
+			data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			data = data != MAP_FAILED ? data : nullptr;
+			allocation.isHugePages = data != nullptr;
+		}
+#endif
+		if (data == nullptr)
+		{
+			data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			data = data != MAP_FAILED ? data : nullptr;
+#ifdef MADV_HUGEPAGE
+			// ... otherwise transparent huge pages are asked for
+			if (data != nullptr && isHugePageSize)
+			{
+				madvise(data, size, MADV_HUGEPAGE);
+			}
+#endif
+		}
+		allocation.isMapped = data != nullptr;
+	}
+#endif
+
+	if (data == nullptr)
+	{
+		throw std::runtime_error("Could not allocate a buffer of " + std::to_string(size) + " bytes");
+	}
+	allocation.size = size;
+	return static_cast<byte *>(data);
+}
+
+/*private*/ void BufferPool::Free(byte *data, const Allocation& allocation)
+{
+#ifdef _WIN32
+	(void)allocation;
+	_aligned_free(data);
+#else
+	if (allocation.isMapped)
+	{
+		munmap(data, allocation.size);
+	}
+	else
+	{
+		std::free(data);
+	}
+#endif
+}
+
+// the sizes are rounded up, so buffers of slightly different sizes (e.g. chunks of
+// the same number of blocks of different files) can be recycled for each other
+/*private*/ size_t BufferPool::GetSizeClass(size_t size, bool useHugePages)
+{
+	size_t unit = BufferPool::CacheLineSize;
+	if (size >= BufferPool::HugePageSize && useHugePages)
+	{
+		unit = BufferPool::HugePageSize;
+	}
+	else if (size >= BufferPool::PageSize)
+	{
+		unit = BufferPool::PageSize;
+	}
+	return (size + unit - 1) / unit * unit;
+}
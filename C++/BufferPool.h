@@ -0,0 +1,116 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "TypeDefs.h"
+
+struct BufferPoolStatistics
+{
+	// buffers handed out and how many of them were recycled ones
+	unsigned long long acquisitions = 0;
+	unsigned long long reuses = 0;
+	// buffers that had to be allocated from the system
+	unsigned long long allocations = 0;
+	unsigned long long reservedBytes = 0;
+	unsigned long long hugePageBytes = 0;
+	// released buffers given back to the system, as the free buffers would have exceeded their limit
+	unsigned long long freedBytes = 0;
+	unsigned long long usedBytes = 0;
+	unsigned long long peakUsedBytes = 0;
+};
+
+class BufferPool;
+
+// a buffer of the pool, which goes back to the pool when the object is destroyed
+class PooledBuffer
+{
+public:
+	PooledBuffer() = default;
+	~PooledBuffer();
+
+	PooledBuffer(PooledBuffer&& other) noexcept;
+	PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+	PooledBuffer(const PooledBuffer&) = delete;
+	PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+	byte *GetData() const;
+	// at least the requested size, the buffer is rounded up to its size class
+	size_t GetSize() const;
+
+	void Release();
+
+private:
+	friend class BufferPool;
+
+	byte *m_data = nullptr;
+	size_t m_size = 0;
+	BufferPool *m_pool = nullptr;
+
+	PooledBuffer(byte *data, size_t size, BufferPool *pool);
+};
+
+// hands out the buffers file data is decrypted in and recycles them, so decrypting one file
+// after the other (or the ranges of a file) does not allocate memory once the buffers of the
+// first file are there; the sizes are rounded up to size classes (multiples of a cache line or
+// of a page for bigger buffers), all buffers are aligned to at least a cache line and buffers
+// of a page or more to a page, as needed for direct I/O; with huge pages, buffers of 2 MB or
+// more are backed by huge pages if the system has some (or transparent huge pages otherwise),
+// which saves TLB misses when the buffers are streamed through; the free buffers are kept up
+// to [maxFreeBytes] in total, a released buffer which doesn't fit anymore is given back to the
+// system right away (a huge page mapping as well), so a single file with big buffers doesn't
+// keep its memory reserved for the rest of the run; the remaining memory is given back when the
+// pool is destroyed, the buffers must be released before
+class BufferPool
+{
+public:
+	BufferPool() = default;
+	~BufferPool();
+
+	BufferPool(const BufferPool&) = delete;
+	BufferPool& operator=(const BufferPool&) = delete;
+
+	// the pool shared by the whole program
+	static BufferPool& Get();
+
+	PooledBuffer Acquire(size_t size);
+	// only affects buffers allocated afterwards
+	void SetHugePages(bool useHugePages);
+	// only affects buffers released afterwards
+	void SetMaxFreeBytes(size_t maxFreeBytes);
+
+	BufferPoolStatistics GetStatistics() const;
+
+	static const size_t CacheLineSize = 64;
+	static const size_t PageSize = 4096;
+	static const size_t HugePageSize = 2 * 1024 * 1024;
+	static const size_t DefaultMaxFreeBytes = 256 * 1024 * 1024;
+
+private:
+	friend class PooledBuffer;
+
+	struct Allocation
+	{
+		size_t size;
+		bool isMapped;
+		bool isHugePages;
+	};
+
+	mutable std::mutex m_mutex;
+	bool m_useHugePages = false;
+	size_t m_maxFreeBytes = DefaultMaxFreeBytes;
+	size_t m_freeBytes = 0;
+	// the free buffers of each size class and how each buffer was allocated
+	std::map<size_t, std::vector<byte *>> m_freeBuffers;
+	std::map<byte *, Allocation> m_allocations;
+	BufferPoolStatistics m_statistics;
+
+	void Release(byte *data, size_t size);
+	byte *Allocate(size_t size, Allocation& allocation);
+	static void Free(byte *data, const Allocation& allocation);
+	static size_t GetSizeClass(size_t size, bool useHugePages);
+};
+
+#endif
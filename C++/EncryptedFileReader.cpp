@@ -0,0 +1,178 @@
+#include "EncryptedFileReader.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "Base64Helper.h"
+#include "aes.h"
+
+EncryptedFileReader::EncryptedFileReader(
+	const MappedFile& encryptedFile, const std::vector<byte>& fileCryptoKey,
+	const std::string& baseIVec, unsigned int blockSize, unsigned int offset, unsigned int padding,
+	BlockCache *blockCache /* = nullptr*/)
+	: m_encryptedFile(encryptedFile), m_blockSize(blockSize), m_offset(offset), m_isPadded(padding > 0), m_blockCache(blockCache)
+{
+	if (fileCryptoKey.empty() || blockSize == 0 || blockSize % CryptoPP::AES::BLOCKSIZE != 0)
+	{
+		throw std::runtime_error("Crypto key for file can't be empty and block size must be a multiple of the AES block size");
+	}
+
+	this->m_bodySize = encryptedFile.GetSize() > offset ? encryptedFile.GetSize() - offset : 0;
+	if (this->m_bodySize % CryptoPP::AES::BLOCKSIZE != 0)
+	{
+		throw std::runtime_error("Length of encrypted file data is not a multiple of the AES block size, make sure the file is not corrupted");
+	}
+
+	// IVec in file header is base 64 encoded, the IVecs
+	// of the single blocks are derived from it
+	std::vector<byte> decodedFileIV;
+	Base64Helper::Decode(baseIVec, decodedFileIV);
+	this->m_blockIVGenerator.reset(new BlockIVGenerator(decodedFileIV, fileCryptoKey));
+	this->m_blockDecryptor.reset(new FileBlockDecryptor(fileCryptoKey, *this->m_blockIVGenerator));
+	this->m_blockBuffer = BufferPool::Get().Acquire(blockSize);
+	if (blockCache != nullptr)
+	{
+		this->m_fileId = blockCache->GetFileId(encryptedFile.GetFilePath(), encryptedFile.GetSize());
+	}
+
+	// only the last block tells how long the plaintext is
+	this->m_plaintextSize = this->m_bodySize;
+	if (this->m_isPadded && this->m_bodySize > 0)
+	{
+		unsigned long long lastBlockNo = (this->m_bodySize - 1) / blockSize;
+		size_t lastBlockLen = 0;
+		this->GetBlock(lastBlockNo, lastBlockLen);
+		this->m_plaintextSize = lastBlockNo * blockSize + lastBlockLen;
+	}
+}
+
+size_t EncryptedFileReader::ReadRange(unsigned long long offset, size_t length, byte *output)
+{
+	if (offset >= this->m_plaintextSize || length == 0)
+	{
+		return 0;
+	}
+
+	unsigned long long end = offset + std::min<unsigned long long>(length, this->m_plaintextSize - offset);
+	const byte *body = this->m_encryptedFile.GetData() + this->m_offset;
+	unsigned long long blockNo = offset / this->m_blockSize;
+	unsigned long long pos = offset;
+	BlockCache::Block foundBlock;
+	unsigned long long foundBlockNo = 0;
+	while (pos < end)
+	{
+		unsigned long long blockPos = blockNo * this->m_blockSize;
+
+		// with a cache each block is looked up first, unless it was found already
+		// while looking for the end of a run of blocks which aren't cached
+		BlockCache::Block cachedBlock;
+		if (this->m_blockCache != nullptr)
+		{
+			cachedBlock = foundBlock != nullptr && foundBlockNo == blockNo ? std::move(foundBlock) : this->m_blockCache->Find(this->m_fileId, blockNo);
+			foundBlock = nullptr;
+		}
+
+		// the blocks which are completely covered by the range are decrypted straight into
+		// the output as one batch; a padded last block is never covered completely, as its
+		// padding lies behind the end of the plaintext; with a cache the batch ends in front
+		// of the next cached block and copies of the decrypted blocks are added to the cache
+		if (pos == blockPos && cachedBlock == nullptr)
+		{
+			unsigned long long coveredLen = end == this->m_bodySize ? end - pos : (end - pos) / this->m_blockSize * this->m_blockSize;
+			if (this->m_blockCache != nullptr && coveredLen > 0)
+			{
+				unsigned long long coveredEndBlockNo = blockNo + (coveredLen + this->m_blockSize - 1) / this->m_blockSize;
+				unsigned long long runEndBlockNo = blockNo + 1;
+				for (; runEndBlockNo < coveredEndBlockNo; ++runEndBlockNo)
+				{
+					foundBlock = this->m_blockCache->Find(this->m_fileId, runEndBlockNo);
+					if (foundBlock != nullptr)
+					{
+						foundBlockNo = runEndBlockNo;
+						break;
+					}
+				}
+				coveredLen = std::min(coveredLen, (runEndBlockNo - blockNo) * this->m_blockSize);
+			}
+
+			if (coveredLen > 0)
+			{
+				byte *plaintext = output + (pos - offset);
+				this->m_blockDecryptor->DecryptBlocks(blockNo, body + pos, plaintext, static_cast<size_t>(coveredLen), this->m_blockSize, false);
+				for (size_t runPos = 0; this->m_blockCache != nullptr && runPos < coveredLen; runPos += this->m_blockSize)
+				{
+					size_t blockPlaintextLen = static_cast<size_t>(std::min<unsigned long long>(this->m_blockSize, coveredLen - runPos));
+					this->m_blockCache->Insert(this->m_fileId, blockNo + runPos / this->m_blockSize,
+						std::make_shared<const std::vector<byte>>(plaintext + runPos, plaintext + runPos + blockPlaintextLen));
+				}
+				pos += coveredLen;
+				blockNo += (coveredLen + this->m_blockSize - 1) / this->m_blockSize;
+				continue;
+			}
+		}
+
+		// the blocks at the borders of the range go through the buffer
+		size_t blockPlaintextLen = 0;
+		const byte *blockPlaintext = nullptr;
+		if (cachedBlock != nullptr)
+		{
+			this->m_cachedBlock = std::move(cachedBlock);
+			blockPlaintextLen = this->m_cachedBlock->size();
+			blockPlaintext = this->m_cachedBlock->data();
+		}
+		else
+		{
+			blockPlaintext = this->DecryptBlockToCache(blockNo, blockPlaintextLen);
+		}
+		size_t posInBlock = static_cast<size_t>(pos - blockPos);
+		size_t copyLen = static_cast<size_t>(std::min<unsigned long long>(blockPlaintextLen - posInBlock, end - pos));
+		std::memcpy(output + (pos - offset), blockPlaintext + posInBlock, copyLen);
+		pos += copyLen;
+		++blockNo;
+	}
+
+	return static_cast<size_t>(end - offset);
+}
+
+unsigned long long EncryptedFileReader::GetPlaintextSize() const
+{
+	return this->m_plaintextSize;
+}
+
+// returns the plaintext of a file block from the cache or decrypts it into the buffer,
+// the pointer stays valid until the next block is requested
+/*private*/ const byte *EncryptedFileReader::GetBlock(unsigned long long blockNo, size_t& plaintextLen)
+{
+	if (this->m_blockCache != nullptr)
+	{
+		this->m_cachedBlock = this->m_blockCache->Find(this->m_fileId, blockNo);
+		if (this->m_cachedBlock != nullptr)
+		{
+			plaintextLen = this->m_cachedBlock->size();
+			return this->m_cachedBlock->data();
+		}
+	}
+
+	return this->DecryptBlockToCache(blockNo, plaintextLen);
+}
+
+// decrypts a file block into the buffer and adds a copy of its plaintext to the cache if there is one
+/*private*/ const byte *EncryptedFileReader::DecryptBlockToCache(unsigned long long blockNo, size_t& plaintextLen)
+{
+	plaintextLen = this->DecryptBlock(blockNo);
+	const byte *plaintext = this->m_blockBuffer.GetData();
+	if (this->m_blockCache != nullptr)
+	{
+		this->m_blockCache->Insert(this->m_fileId, blockNo, std::make_shared<const std::vector<byte>>(plaintext, plaintext + plaintextLen));
+	}
+	return plaintext;
+}
+
+// decrypts a single file block into the buffer and returns the length of its plaintext
+/*private*/ size_t EncryptedFileReader::DecryptBlock(unsigned long long blockNo)
+{
+	unsigned long long blockPos = blockNo * this->m_blockSize;
+	size_t blockLen = static_cast<size_t>(std::min<unsigned long long>(this->m_blockSize, this->m_bodySize - blockPos));
+	bool isLastBlock = blockPos + blockLen == this->m_bodySize;
+	const byte *ciphertext = this->m_encryptedFile.GetData() + this->m_offset + blockPos;
+	return this->m_blockDecryptor->DecryptBlocks(blockNo, ciphertext, this->m_blockBuffer.GetData(), blockLen, this->m_blockSize, isLastBlock && this->m_isPadded);
+}
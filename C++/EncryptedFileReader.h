@@ -0,0 +1,60 @@
+#ifndef ENCRYPTEDFILEREADER_H
+#define ENCRYPTEDFILEREADER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "TypeDefs.h"
+#include "BlockCache.h"
+#include "BlockIVGenerator.h"
+#include "BufferPool.h"
+#include "FileBlockDecryptor.h"
+#include "MappedFile.h"
+
+// decrypts arbitrary byte ranges of the plaintext of an encrypted file: the IVec of each
+// file block only depends on the base IVec, the block number and the file key, so only the
+// file blocks covering a range have to be decrypted, no matter where in the file it is;
+// the parameters are the same as for AESHelper::DecryptFile, [encryptedFile] must outlive
+// the reader and a single reader must not be used by several threads at once; with a
+// [blockCache] (which may be shared by the readers of all threads) every block is looked
+// up there first, the runs of blocks which aren't cached are decrypted as one batch and
+// copies of the decrypted blocks are added to it
+class EncryptedFileReader
+{
+public:
+	EncryptedFileReader(
+		const MappedFile& encryptedFile, const std::vector<byte>& fileCryptoKey,
+		const std::string& baseIVec, unsigned int blockSize, unsigned int offset, unsigned int padding,
+		BlockCache *blockCache = nullptr);
+
+	EncryptedFileReader(const EncryptedFileReader&) = delete;
+	EncryptedFileReader& operator=(const EncryptedFileReader&) = delete;
+
+	// decrypts up to [length] bytes of plaintext starting at [offset] into [output] and
+	// returns the number of bytes read, which is only smaller at the end of the plaintext
+	size_t ReadRange(unsigned long long offset, size_t length, byte *output);
+
+	// the size of the plaintext, the padding of the last block is checked when the reader is created
+	unsigned long long GetPlaintextSize() const;
+
+private:
+	const MappedFile& m_encryptedFile;
+	unsigned int m_blockSize;
+	unsigned int m_offset;
+	bool m_isPadded;
+	unsigned long long m_bodySize = 0;
+	unsigned long long m_plaintextSize = 0;
+	std::unique_ptr<BlockIVGenerator> m_blockIVGenerator;
+	std::unique_ptr<FileBlockDecryptor> m_blockDecryptor;
+	PooledBuffer m_blockBuffer;
+	BlockCache *m_blockCache;
+	unsigned long long m_fileId = 0;
+	BlockCache::Block m_cachedBlock;
+
+	const byte *GetBlock(unsigned long long blockNo, size_t& plaintextLen);
+	const byte *DecryptBlockToCache(unsigned long long blockNo, size_t& plaintextLen);
+	size_t DecryptBlock(unsigned long long blockNo);
+};
+
+#endif
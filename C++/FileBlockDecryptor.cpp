@@ -0,0 +1,112 @@
+#include "FileBlockDecryptor.h"
+#include <stdexcept>
+#include <string>
+#include "RunStatistics.h"
+
+FileBlockDecryptor::FileBlockDecryptor(const std::vector<byte>& fileCryptoKey, const BlockIVGenerator& blockIVGenerator)
+{
+	this->SetKey(fileCryptoKey, blockIVGenerator);
+}
+
+void FileBlockDecryptor::SetKey(const std::vector<byte>& fileCryptoKey, const BlockIVGenerator& blockIVGenerator)
+{
+	if (fileCryptoKey.size() > 0 && blockIVGenerator.GetIVecSize() == CryptoPP::AES::BLOCKSIZE)
+	{
+		this->m_aesDecryptor.SetKey(fileCryptoKey.data(), fileCryptoKey.size());
+		this->m_blockIVGenerator = &blockIVGenerator;
+	}
+	else
+	{
+		throw std::runtime_error("Crypto key for file can't be empty and the initialization vector must be 16 bytes long");
+	}
+}
+
+size_t FileBlockDecryptor::DecryptBlock(unsigned long long blockNo, byte *block, size_t blockLen, bool removePadding)
+{
+	return this->DecryptBlocks(blockNo, block, blockLen, blockLen, removePadding);
+}
+
+size_t FileBlockDecryptor::DecryptBlocks(unsigned long long firstBlockNo, byte *blocks, size_t len, size_t blockSize, bool removePadding)
+{
+	return this->DecryptBlocks(firstBlockNo, blocks, blocks, len, blockSize, removePadding);
+}
+
+size_t FileBlockDecryptor::DecryptBlocks(unsigned long long firstBlockNo, const byte *input, byte *output, size_t len, size_t blockSize, bool removePadding)
+{
+	const size_t aesBlockSize = CryptoPP::AES::BLOCKSIZE;
+	if (len == 0 || len % aesBlockSize != 0 || blockSize == 0 || blockSize % aesBlockSize != 0)
+	{
+		throw std::runtime_error("Length of encrypted block " + std::to_string(firstBlockNo) + " is not a multiple of the AES block size");
+	}
+
+	// CBC decryption of the whole batch treats it like one long chain, i.e. the first AES block
+	// of every file block gets XORed with the last ciphertext block of the previous file block
+	// instead of its own IVec; remember the difference of the two before the ciphertext may be
+	// overwritten, so it can be corrected afterwards
+	size_t blockCount = (len + blockSize - 1) / blockSize;
+	if (this->m_chainCorrections.GetSize() < blockCount * aesBlockSize)
+	{
+		this->m_chainCorrections = BufferPool::Get().Acquire(blockCount * aesBlockSize);
+	}
+	byte *corrections = this->m_chainCorrections.GetData();
+	{
+		StageTimer timer(Stage::IVDerivation);
+		for (size_t i = 0; i < blockCount; ++i)
+		{
+			byte *correction = corrections + i * aesBlockSize;
+			this->m_blockIVGenerator->ComputeBlockIVec(firstBlockNo + i, correction);
+			if (i > 0)
+			{
+				const byte *previousCiphertext = input + i * blockSize - aesBlockSize;
+				for (size_t j = 0; j < aesBlockSize; ++j)
+				{
+					correction[j] ^= previousCiphertext[j];
+				}
+			}
+		}
+	}
+
+	// reading a mapped input happens here as well, its page faults count as AES time
+	StageTimer timer(Stage::AES);
+
+	// this is the same call the CBC mode of Crypto++ uses internally: working backwards
+	// allows decrypting in place, every AES block is XORed with the ciphertext in front of it
+	if (len > aesBlockSize)
+	{
+		this->m_aesDecryptor.AdvancedProcessBlocks(input + aesBlockSize, input, output + aesBlockSize, len - aesBlockSize,
+			CryptoPP::BlockTransformation::BT_ReverseDirection | CryptoPP::BlockTransformation::BT_AllowParallel);
+	}
+
+	// the very first AES block has no ciphertext in front of it and takes the IVec directly,
+	// all other file blocks get the correction computed above
+	this->m_aesDecryptor.ProcessAndXorBlock(input, corrections, output);
+	for (size_t i = 1; i < blockCount; ++i)
+	{
+		byte *firstAESBlock = output + i * blockSize;
+		const byte *correction = corrections + i * aesBlockSize;
+		for (size_t j = 0; j < aesBlockSize; ++j)
+		{
+			firstAESBlock[j] ^= correction[j];
+		}
+	}
+
+	if (!removePadding)
+	{
+		return len;
+	}
+
+	// PKCS7 padding (https://en.wikipedia.org/wiki/PKCS): the value
+	// of each padding byte is the number of padding bytes
+	byte paddingLen = output[len - 1];
+	bool isValidPadding = paddingLen > 0 && paddingLen <= aesBlockSize;
+	for (size_t i = 1; isValidPadding && i <= paddingLen; ++i)
+	{
+		isValidPadding = output[len - i] == paddingLen;
+	}
+
+	if (!isValidPadding)
+	{
+		throw std::runtime_error("Invalid PKCS7 padding found in last block, make sure the file is not corrupted");
+	}
+	return len - paddingLen;
+}
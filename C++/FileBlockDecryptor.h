@@ -0,0 +1,46 @@
+#ifndef FILEBLOCKDECRYPTOR_H
+#define FILEBLOCKDECRYPTOR_H
+
+#include <vector>
+#include "TypeDefs.h"
+#include "BlockIVGenerator.h"
+#include "BufferPool.h"
+#include "aes.h"
+
+// decrypts the blocks of one file in place; the AES key schedule is computed once when
+// the object is created (or given the key of the next file), afterwards the blocks are decrypted
+// in CBC mode with their own IVec, the chaining is done here, so a single object must not be
+// used by several threads
+class FileBlockDecryptor
+{
+public:
+	FileBlockDecryptor(const std::vector<byte>& fileCryptoKey, const BlockIVGenerator& blockIVGenerator);
+
+	FileBlockDecryptor(const FileBlockDecryptor&) = delete;
+	FileBlockDecryptor& operator=(const FileBlockDecryptor&) = delete;
+
+	// switches to the blocks of another file, the buffers of the object are kept
+	void SetKey(const std::vector<byte>& fileCryptoKey, const BlockIVGenerator& blockIVGenerator);
+
+	// decrypts [blockLen] bytes at [block] and returns the length of the plaintext,
+	// which is shorter than [blockLen] if the PKCS7 padding has to be removed
+	size_t DecryptBlock(unsigned long long blockNo, byte *block, size_t blockLen, bool removePadding);
+
+	// decrypts the consecutive blocks in [blocks] (all of them [blockSize] bytes long except
+	// the last one) starting with block [firstBlockNo] as one batch and returns the length of
+	// the plaintext; the whole batch goes through the AES implementation at once, so the
+	// parallel AES-NI pipelines of Crypto++ stay filled even if the blocks are small
+	size_t DecryptBlocks(unsigned long long firstBlockNo, byte *blocks, size_t len, size_t blockSize, bool removePadding);
+
+	// same as above, but reads the ciphertext from [input] and writes the plaintext to [output],
+	// so read-only input (e.g. a mapped file) doesn't have to be copied first; both pointers
+	// may be the same for in place decryption, other overlaps are not allowed
+	size_t DecryptBlocks(unsigned long long firstBlockNo, const byte *input, byte *output, size_t len, size_t blockSize, bool removePadding);
+
+private:
+	CryptoPP::AES::Decryption m_aesDecryptor;
+	const BlockIVGenerator *m_blockIVGenerator = nullptr;
+	PooledBuffer m_chainCorrections;
+};
+
+#endif
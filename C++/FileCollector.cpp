@@ -0,0 +1,111 @@
+#include "FileCollector.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include "HeaderIndex.h"
+
+namespace fs = std::filesystem;
+
+void FileCollector::CollectPath(const std::string& path, const std::string& outputPath, std::vector<EncryptedFileEntry>& files)
+{
+	std::error_code error;
+	if (!fs::is_directory(path, error))
+	{
+		files.push_back({ path, outputPath });
+		return;
+	}
+
+	// unreadable subdirectories are skipped instead of failing the whole batch
+	std::vector<std::string> encryptedFilePaths;
+	auto options = fs::directory_options::skip_permission_denied;
+	for (fs::recursive_directory_iterator it(path, options, error), end; !error && it != end; it.increment(error))
+	{
+		if (it->is_regular_file(error) && it->path().extension() == ".bc")
+		{
+			encryptedFilePaths.push_back(it->path().string());
+		}
+	}
+	if (error)
+	{
+		throw std::runtime_error("Directory (" + path + ") could not be searched for encrypted files: " + error.message());
+	}
+
+	std::sort(encryptedFilePaths.begin(), encryptedFilePaths.end());
+	for (const auto& encryptedFilePath : encryptedFilePaths)
+	{
+		std::string relativePath = fs::path(encryptedFilePath).lexically_relative(path).string();
+		files.push_back({ encryptedFilePath, FileCollector::GetOutputPath(relativePath, outputPath) });
+	}
+}
+
+void FileCollector::CollectManifest(const std::string& manifestPath, const std::string& outputDirectory, std::vector<EncryptedFileEntry>& files)
+{
+	std::ifstream manifest(manifestPath);
+	if (!manifest.good())
+	{
+		std::string errorMsg("Manifest (" + manifestPath + ") can't be opened (make sure the provided path is correct, the file exists and you have the right to open the file)");
+		throw std::runtime_error(errorMsg.c_str());
+	}
+
+	std::string line;
+	while (std::getline(manifest, line))
+	{
+		// tolerate manifests with windows line endings
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		std::error_code error;
+		if (fs::is_directory(line, error))
+		{
+			FileCollector::CollectPath(line, outputDirectory, files);
+		}
+		else
+		{
+			std::string fileName = fs::path(line).filename().string();
+			files.push_back({ line, FileCollector::GetOutputPath(fileName, outputDirectory) });
+		}
+	}
+}
+
+void FileCollector::CollectIndex(const HeaderIndex& index, const std::string& outputDirectory, std::vector<EncryptedFileEntry>& files)
+{
+	std::error_code error;
+	bool hasRootDirectory = !index.GetRootPath().empty() && fs::is_directory(index.GetRootPath(), error);
+	for (const auto& entry : index.GetEntries())
+	{
+		std::string relativePath = fs::path(entry.encryptedFilePath).filename().string();
+		if (hasRootDirectory)
+		{
+			fs::path rootRelativePath = fs::path(entry.encryptedFilePath).lexically_relative(index.GetRootPath());
+			if (!rootRelativePath.empty() && *rootRelativePath.begin() != "..")
+			{
+				relativePath = rootRelativePath.string();
+			}
+		}
+		files.push_back({ entry.encryptedFilePath, FileCollector::GetOutputPath(relativePath, outputDirectory), &entry });
+	}
+}
+
+// the output of "dir/file.txt.bc" is "[outputDirectory]/dir/file.txt", without an
+// output directory the path stays empty and the output is put next to the encrypted file
+/*private*/ std::string FileCollector::GetOutputPath(const std::string& relativePath, const std::string& outputDirectory)
+{
+	if (outputDirectory.empty())
+	{
+		return "";
+	}
+
+	fs::path outputPath = fs::path(outputDirectory) / relativePath;
+	if (outputPath.extension() == ".bc")
+	{
+		outputPath.replace_extension();
+	}
+	return outputPath.string();
+}
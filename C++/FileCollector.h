@@ -0,0 +1,44 @@
+#ifndef FILECOLLECTOR_H
+#define FILECOLLECTOR_H
+
+#include <string>
+#include <vector>
+
+struct HeaderIndexEntry;
+class HeaderIndex;
+
+// an encrypted file and the path its plaintext should be written to,
+// an empty output path lets FileData derive it from the encrypted file;
+// files taken from a header index keep a reference to their entry
+struct EncryptedFileEntry
+{
+	std::string encryptedFilePath;
+	std::string outputFilePath;
+	const HeaderIndexEntry *indexEntry = nullptr;
+};
+
+// gathers the encrypted files of a batch run, so the private key
+// only has to be decrypted once for all of them
+class FileCollector
+{
+public:
+	FileCollector() = delete;
+
+	// adds a single .bc file with its output path or, if [path] is a directory, all .bc files
+	// below it (sorted by path); their outputs keep the directory structure below [outputPath]
+	static void CollectPath(const std::string& path, const std::string& outputPath, std::vector<EncryptedFileEntry>& files);
+
+	// adds every path listed in a manifest (one file or directory per line, empty lines and
+	// lines starting with '#' are skipped); the outputs of listed files are put directly into
+	// [outputDirectory], the ones of listed directories keep their structure below it
+	static void CollectManifest(const std::string& manifestPath, const std::string& outputDirectory, std::vector<EncryptedFileEntry>& files);
+
+	// adds every file of a header index, the outputs of files below the root path of the index
+	// keep their structure below [outputDirectory], the other ones are put directly into it
+	static void CollectIndex(const HeaderIndex& index, const std::string& outputDirectory, std::vector<EncryptedFileEntry>& files);
+
+private:
+	static std::string GetOutputPath(const std::string& relativePath, const std::string& outputDirectory);
+};
+
+#endif
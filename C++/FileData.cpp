@@ -1,126 +1,107 @@
 #include "FileData.h"
+#include <algorithm>
 #include <fstream>
-#include <iostream>
+#include <limits>
 #include <vector>
 #include <stdexcept>
 #include "TypeDefs.h"
+#include "HeaderIndex.h"
+#include "JSONReader.h"
+#include "Log.h"
 
-// this method should ideally be implemented using a proper JSON library,
-// but for the purpose of demonstrating which infos are needed from
-// the file header simple string searches should be sufficient
 bool FileData::ParseHeader(const std::string& encryptedFilePath, const std::string& outputFilePath)
 {
-	std::cout << "Parsing header of encrypted file: '" << encryptedFilePath << "'" << std::endl;
+	FileData::CheckExtension(encryptedFilePath);
 
-	if (encryptedFilePath.substr(encryptedFilePath.length() - 3) != ".bc")
-	{
-		throw std::runtime_error("Given filepath does not have the right extension ('.bc'), please specify a Boxcryptor encrypted file");
-	}
+	MappedFile encryptedFile(encryptedFilePath);
+	this->ParseHeader(encryptedFile);
+	this->SetOutputFilepath(outputFilePath);
+	return true;
+}
 
-	std::ifstream headerFile(encryptedFilePath, std::ios::binary);
-	if (!headerFile.good())
+bool FileData::ParseHeader(const MappedFile& encryptedFile, bool silent /* = false*/)
+{
+	return this->ParseHeader(encryptedFile.GetFilePath(), encryptedFile.GetData(), encryptedFile.GetSize(), silent);
+}
+
+bool FileData::ParseHeader(const std::string& encryptedFilePath, const byte *data, size_t size, bool silent /* = false*/)
+{
+	if (!silent)
 	{
-		std::string errorMsg("Encrypted file (" + encryptedFilePath + ") can't be opened (make sure the provided path is correct, the file exists and you have the right to open the file)");
-		throw std::runtime_error(errorMsg.c_str());
+		LOG_DEBUG("Parsing header of encrypted file: '" << encryptedFilePath << "'");
 	}
 
+	FileData::CheckExtension(encryptedFilePath);
+
 	this->m_encryptedFilePath = encryptedFilePath;
 
-	// read the first 16 bytes which contain the file version
-	// and information about the length of the different file parts
-	std::vector<char> rawHeaderBytes(16);
-	headerFile.read(&rawHeaderBytes[0], 16);
+	// the first 16 bytes contain the file version and information
+	// about the length of the different file parts
+	unsigned int headerRawLen = FileData::RawHeaderLen; // always 48 bytes
+	const byte *rawHeaderBytes = data;
+	if (size < headerRawLen)
+	{
+		throw std::runtime_error("Encrypted file is too short to contain a file header, make sure the file is not corrupted");
+	}
 
-	auto fileVersionBytes = std::vector<byte>(rawHeaderBytes.begin(), rawHeaderBytes.begin() + 4);
-	if (fileVersionBytes != this->m_supportedFileVersion)
+	if (!std::equal(this->m_supportedFileVersion.begin(), this->m_supportedFileVersion.end(), rawHeaderBytes))
 	{
 		throw std::runtime_error("Unknown file version found in header, aborting...");
 	}
 
-	auto headerCoreLenBytes = std::vector<byte>(rawHeaderBytes.begin() + 4, rawHeaderBytes.begin() + 8);
-	auto headerPaddingLenBytes = std::vector<byte>(rawHeaderBytes.begin() + 8, rawHeaderBytes.begin() + 12);
-	auto cipherPaddingLenBytes = std::vector<byte>(rawHeaderBytes.begin() + 12, rawHeaderBytes.begin() + 16);
+	const byte *headerCoreLenBytes = rawHeaderBytes + 4;
+	const byte *headerPaddingLenBytes = rawHeaderBytes + 8;
+	const byte *cipherPaddingLenBytes = rawHeaderBytes + 12;
 
-	unsigned int headerRawLen = 48; // always 48 bytes
-	unsigned int headerCoreLen = headerCoreLenBytes.at(3) << 24 | headerCoreLenBytes.at(2) << 16 | headerCoreLenBytes.at(1) << 8 | headerCoreLenBytes.at(0);
-	unsigned int headerPaddingLen = headerPaddingLenBytes.at(3) << 24 | headerPaddingLenBytes.at(2) << 16 | headerPaddingLenBytes.at(1) << 8 | headerPaddingLenBytes.at(0);
-	unsigned int cipherPaddingLen = cipherPaddingLenBytes.at(3) << 24 | cipherPaddingLenBytes.at(2) << 16 | cipherPaddingLenBytes.at(1) << 8 | cipherPaddingLenBytes.at(0);
+	unsigned int headerCoreLen = headerCoreLenBytes[3] << 24 | headerCoreLenBytes[2] << 16 | headerCoreLenBytes[1] << 8 | headerCoreLenBytes[0];
+	unsigned int headerPaddingLen = headerPaddingLenBytes[3] << 24 | headerPaddingLenBytes[2] << 16 | headerPaddingLenBytes[1] << 8 | headerPaddingLenBytes[0];
+	unsigned int cipherPaddingLen = cipherPaddingLenBytes[3] << 24 | cipherPaddingLenBytes[2] << 16 | cipherPaddingLenBytes[1] << 8 | cipherPaddingLenBytes[0];
 
 	this->m_headerData.rawLen = headerRawLen;
 	this->m_headerData.coreLen = headerCoreLen;
 	this->m_headerData.corePaddingLen = headerPaddingLen;
 	this->m_headerData.cipherPaddingLen = cipherPaddingLen;
 
-	// go to the end of the raw header and read the core header
-	headerFile.seekg(this->m_headerData.rawLen);
-	std::vector<char> coreHeaderBytes(headerCoreLen);
-	headerFile.read(&coreHeaderBytes[0], this->m_headerData.coreLen);
-
-	std::string coreHeader(coreHeaderBytes.begin(), coreHeaderBytes.end());
-	
-	// find the blocksize
-	std::string searchString = R"("blockSize")";
-	size_t posBegin = coreHeader.find(searchString);
-	posBegin = coreHeader.find(":", posBegin + searchString.length());
-	size_t posEnd = coreHeader.find(",", posBegin + 1);
-
-	if (posBegin != std::string::npos && posEnd != std::string::npos && posEnd - posBegin > 0)
-	{
-		std::string blockSize = coreHeader.substr(posBegin + 1, posEnd - posBegin - 1);
-		try { this->m_blockSize = std::stoi(blockSize); }
-		catch (...) { throw std::runtime_error("Could not convert block size to integer"); }
-	}
-	else
+	// the core header follows the raw header
+	if (size - headerRawLen < headerCoreLen)
 	{
-		throw std::runtime_error("Could not find block size in file header");
+		throw std::runtime_error("Encrypted file is too short to contain the core file header, make sure the file is not corrupted");
 	}
+	const char *coreHeaderBytes = reinterpret_cast<const char *>(rawHeaderBytes + headerRawLen);
+	this->ParseCoreHeader(std::string_view(coreHeaderBytes, headerCoreLen));
 
-	// find the initialization vector
-	searchString = R"("iv")";
-	posBegin = coreHeader.find(searchString);
-	posBegin = coreHeader.find(R"(")", posBegin + searchString.length());
-	posEnd = coreHeader.find(R"(")", posBegin + 1);
-
-	if (posBegin != std::string::npos && posEnd != std::string::npos && posEnd - posBegin > 0)
+	if (!silent)
 	{
-		this->m_baseIVec = coreHeader.substr(posBegin + 1, posEnd - posBegin - 1);
+		LOG_DEBUG("Parsing finished");
 	}
-	else
-	{
-		throw std::runtime_error("Could not find initialization vector in file header");
-	}
-
-	// find the (first) encrypted file key object
-	searchString = R"("encryptedFileKeys")";
-	posBegin = coreHeader.find(searchString);
-	posBegin = coreHeader.find("{", posBegin + searchString.length());
-	posEnd = coreHeader.find("}", posBegin + 1);
-
-	// and the 'value' within
-	searchString = R"("value")";
-	posBegin = coreHeader.find(searchString, posBegin + 1);
-	posBegin = coreHeader.find(R"(")", posBegin + searchString.length());
+	return true;
+}
 
-	// check if we are still in the right block / JSON object
-	if (posBegin > posEnd)
-	{
-		throw std::runtime_error("The (first) file key object has no suitable key value");
-	}
-	posEnd = coreHeader.find(R"(")", posBegin + 1);
+unsigned long long FileData::GetParsedHeaderLen(const byte *rawHeaderBytes)
+{
+	const byte *headerCoreLenBytes = rawHeaderBytes + 4;
+	unsigned int headerCoreLen = headerCoreLenBytes[3] << 24 | headerCoreLenBytes[2] << 16 | headerCoreLenBytes[1] << 8 | headerCoreLenBytes[0];
+	return static_cast<unsigned long long>(FileData::RawHeaderLen) + headerCoreLen;
+}
 
-	if (posBegin != std::string::npos && posEnd != std::string::npos && posEnd - posBegin > 0)
-	{
-		this->m_encryptedFileKey = coreHeader.substr(posBegin + 1, posEnd - posBegin - 1);
-	}
-	else
+void FileData::LoadHeader(const HeaderIndexEntry& indexEntry)
+{
+	this->m_encryptedFilePath = indexEntry.encryptedFilePath;
+	this->m_headerData = indexEntry.headerData;
+	this->m_blockSize = indexEntry.blockSize;
+	this->m_baseIVec = indexEntry.baseIVec;
+	this->m_encryptedFileKeys = indexEntry.fileKeys;
+	if (this->m_encryptedFileKeys.empty())
 	{
 		throw std::runtime_error("Could not find file key in file header");
 	}
+}
 
+// has to be called after the header was parsed, if [outputFilePath] is empty
+// the output path is derived from the path of the encrypted file
+void FileData::SetOutputFilepath(const std::string& outputFilePath)
+{
 	this->m_outputFilePath = this->CheckOutputFilepath(outputFilePath);
-
-	std::cout << "Parsing finished" << std::endl;
-	return true;
 }
 
 std::string FileData::GetOutputFilepath() const
@@ -130,7 +111,12 @@ std::string FileData::GetOutputFilepath() const
 
 std::string FileData::GetEncryptedFileKey() const
 {
-	return this->m_encryptedFileKey;
+	return this->m_encryptedFileKeys.at(0).value;
+}
+
+const std::vector<EncryptedFileKey>& FileData::GetEncryptedFileKeys() const
+{
+	return this->m_encryptedFileKeys;
 }
 
 std::string FileData::GetEncryptedFilePath() const
@@ -158,6 +144,112 @@ unsigned int FileData::GetCipherPadding() const
 	return this->m_headerData.cipherPaddingLen;
 }
 
+const HeaderData& FileData::GetHeaderData() const
+{
+	return this->m_headerData;
+}
+
+// the core header is read in one pass without copying it; 'blockSize' and 'iv' are taken
+// from the top level or the 'cipher' object, the first one found wins, and every entry
+// of 'encryptedFileKeys' with a key value is kept in the order of the header
+/*private*/ void FileData::ParseCoreHeader(std::string_view coreHeader)
+{
+	bool hasBlockSize = false;
+	bool hasBaseIVec = false;
+	this->m_encryptedFileKeys.clear();
+
+	JSONReader reader(coreHeader);
+	auto parseCipherMember = [&](std::string_view name)
+	{
+		if (name == "blockSize" && !hasBlockSize)
+		{
+			unsigned long long blockSize = reader.ReadUnsignedInteger();
+			if (blockSize > std::numeric_limits<unsigned int>::max())
+			{
+				throw std::runtime_error("Could not convert block size to integer");
+			}
+			this->m_blockSize = static_cast<unsigned int>(blockSize);
+			hasBlockSize = true;
+		}
+		else if (name == "iv" && !hasBaseIVec)
+		{
+			this->m_baseIVec = reader.ReadString();
+			hasBaseIVec = true;
+		}
+		else
+		{
+			reader.SkipValue();
+		}
+	};
+
+	try
+	{
+		std::string_view name;
+		reader.BeginObject();
+		while (reader.NextMember(name))
+		{
+			if (name == "cipher")
+			{
+				reader.BeginObject();
+				while (reader.NextMember(name))
+				{
+					parseCipherMember(name);
+				}
+			}
+			else if (name == "encryptedFileKeys")
+			{
+				reader.BeginArray();
+				while (reader.NextElement())
+				{
+					EncryptedFileKey fileKey;
+					reader.BeginObject();
+					while (reader.NextMember(name))
+					{
+						if (name == "type") { fileKey.type = reader.ReadString(); }
+						else if (name == "id") { fileKey.id = reader.ReadString(); }
+						else if (name == "value") { fileKey.value = reader.ReadString(); }
+						else { reader.SkipValue(); }
+					}
+
+					if (fileKey.value.length() > 0)
+					{
+						this->m_encryptedFileKeys.push_back(std::move(fileKey));
+					}
+				}
+			}
+			else
+			{
+				parseCipherMember(name);
+			}
+		}
+	}
+	catch (const std::runtime_error& e)
+	{
+		throw std::runtime_error(std::string("Could not parse file header: ") + e.what());
+	}
+
+	if (!hasBlockSize)
+	{
+		throw std::runtime_error("Could not find block size in file header");
+	}
+	if (!hasBaseIVec || this->m_baseIVec.length() == 0)
+	{
+		throw std::runtime_error("Could not find initialization vector in file header");
+	}
+	if (this->m_encryptedFileKeys.empty())
+	{
+		throw std::runtime_error("Could not find file key in file header");
+	}
+}
+
+/*private*/ void FileData::CheckExtension(const std::string& encryptedFilePath)
+{
+	if (encryptedFilePath.length() < 3 || encryptedFilePath.substr(encryptedFilePath.length() - 3) != ".bc")
+	{
+		throw std::runtime_error("Given filepath does not have the right extension ('.bc'), please specify a Boxcryptor encrypted file");
+	}
+}
+
 // appends a incrementing number to either the output path
 // or the original path if no output was given until
 // a path is found for which no file exists yet
@@ -172,7 +264,7 @@ unsigned int FileData::GetCipherPadding() const
 	{
 		if (newPath.length() == 0)
 		{
-			std::cout << "Output filepath is empty, deriving it from input" << std::endl;
+			LOG_DEBUG("Output filepath is empty, deriving it from input");
 
 			// first, get rid of the .bc extension
 			size_t startPos = 0;
@@ -184,7 +276,7 @@ unsigned int FileData::GetCipherPadding() const
 
 		if (std::ifstream(newPath))
 		{
-			std::cout << "Output filepath '" << newPath << "' already exists, deriving a new one" << std::endl;
+			LOG_INFO("Output filepath '" << newPath << "' already exists, deriving a new one");
 
 			// insert a number after the file name
 			size_t extensionPos = originalPath.find_last_of(".");
@@ -199,7 +291,7 @@ unsigned int FileData::GetCipherPadding() const
 			break;
 		}
 
-		std::cout << "New output filepath: " << newPath << std::endl;
+		LOG_INFO("New output filepath: " << newPath);
 	}
 
 	if (!suitablePathFound)
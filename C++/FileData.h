@@ -2,8 +2,10 @@
 #define FILEINFORMATION_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include "TypeDefs.h"
+#include "MappedFile.h"
 
 struct HeaderData
 {
@@ -13,6 +15,17 @@ struct HeaderData
 	unsigned int cipherPaddingLen;
 };
 
+struct HeaderIndexEntry;
+
+// one entry of 'encryptedFileKeys' in the file header, the file key
+// encrypted for a user (or group) with its public RSA key
+struct EncryptedFileKey
+{
+	std::string type;
+	std::string id;
+	std::string value;
+};
+
 class FileData
 {
 public:
@@ -21,16 +34,31 @@ public:
 	FileData& operator=(const FileData&) = delete;
 
 	bool ParseHeader(const std::string& encryptedFilePath, const std::string& outputFilePath);
+	bool ParseHeader(const MappedFile& encryptedFile, bool silent = false);
+	// parses the header from the first [size] bytes of the file, which were read into [data]
+	// without mapping the file; at least the raw and the core header must be there
+	bool ParseHeader(const std::string& encryptedFilePath, const byte *data, size_t size, bool silent = false);
+	// takes the header from an index instead of parsing the file again
+	void LoadHeader(const HeaderIndexEntry& indexEntry);
+	void SetOutputFilepath(const std::string& outputFilePath);
 	std::string GetOutputFilepath() const;
+	// the (first) encrypted file key
 	std::string GetEncryptedFileKey() const;
+	const std::vector<EncryptedFileKey>& GetEncryptedFileKeys() const;
 	std::string GetEncryptedFilePath() const;
 	std::string GetBaseIVec() const;
 	unsigned int GetBlockSize() const;
 	unsigned int GetHeaderLen() const;
 	unsigned int GetCipherPadding() const;
+	const HeaderData& GetHeaderData() const;
+
+	// the length of the raw and the core header, taken from the first [RawHeaderLen] bytes of
+	// a file, which is all that has to be read for ParseHeader
+	static unsigned long long GetParsedHeaderLen(const byte *rawHeaderBytes);
+	static const unsigned int RawHeaderLen = 48;
 
 private:
-	std::string m_encryptedFileKey;
+	std::vector<EncryptedFileKey> m_encryptedFileKeys;
 	std::string m_baseIVec;
 	std::string m_encryptedFilePath;
 	unsigned int m_blockSize;
@@ -41,6 +69,8 @@ private:
 	// Note: There is another file version for bc02 now.
 	const std::vector<byte> m_supportedFileVersion = { 98, 99, 48, 49 };
 
+	void ParseCoreHeader(std::string_view coreHeader);
+	static void CheckExtension(const std::string& encryptedFilePath);
 	std::string CheckOutputFilepath(const std::string& currentPath);
 };
 
@@ -0,0 +1,271 @@
+#include "FileKeyUnwrapper.h"
+#include <algorithm>
+#include <stdexcept>
+#include "AsyncIO.h"
+#include "BufferPool.h"
+#include "HeaderIndex.h"
+#include "RSAHelper.h"
+#include "RunStatistics.h"
+#include "ThreadPool.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FileKeyUnwrapper::FileKeyUnwrapper(
+	const std::vector<EncryptedFileEntry>& files, const RSAPrivateKey& privateKey, const std::string& userId,
+	unsigned int threadCount, size_t maxPendingFiles, bool isMapped /* = true*/, bool isDirectIO /* = false*/)
+	: m_files(files), m_privateKey(privateKey), m_userId(userId), m_threadCount(threadCount), m_maxPendingFiles(maxPendingFiles),
+	m_isMapped(isMapped), m_isDirectIO(isDirectIO), m_unwrappedFiles(files.size())
+{
+	if (threadCount == 0 || maxPendingFiles < threadCount)
+	{
+		throw std::runtime_error("Thread count must be bigger than zero and at least as many files as threads must be allowed to wait for decryption");
+	}
+
+	// the thread starts last, after all members it uses are initialized
+	this->m_worker = std::thread(&FileKeyUnwrapper::WorkerLoop, this);
+}
+
+FileKeyUnwrapper::~FileKeyUnwrapper()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		this->m_stop = true;
+	}
+	this->m_fileTaken.notify_all();
+	this->m_worker.join();
+}
+
+UnwrappedFile FileKeyUnwrapper::Next()
+{
+	std::unique_lock<std::mutex> lock(this->m_mutex);
+	if (this->m_takenCount >= this->m_files.size())
+	{
+		throw std::runtime_error("All files were already taken from the file key unwrapper");
+	}
+
+	this->m_fileUnwrapped.wait(lock, [this] { return this->m_unwrappedCount > this->m_takenCount; });
+	UnwrappedFile unwrappedFile = std::move(this->m_unwrappedFiles[this->m_takenCount++]);
+	lock.unlock();
+
+	this->m_fileTaken.notify_all();
+	return unwrappedFile;
+}
+
+/*private*/ void FileKeyUnwrapper::WorkerLoop()
+{
+	ThreadPool threadPool(this->m_threadCount);
+	size_t windowSize = threadPool.GetThreadCount();
+	for (size_t windowBegin = 0; windowBegin < this->m_files.size(); windowBegin += windowSize)
+	{
+		// wait until the decryption caught up far enough, so there
+		// is room for the files of the next window
+		{
+			std::unique_lock<std::mutex> lock(this->m_mutex);
+			this->m_fileTaken.wait(lock, [&] { return this->m_stop || windowBegin + windowSize <= this->m_takenCount + this->m_maxPendingFiles; });
+			if (this->m_stop)
+			{
+				return;
+			}
+		}
+
+		// each file only touches its own result, the errors are kept with the file
+		size_t windowEnd = std::min(windowBegin + windowSize, this->m_files.size());
+		threadPool.ParallelFor(windowEnd - windowBegin, [&](size_t fileNo)
+		{
+			this->Unwrap(this->m_files[windowBegin + fileNo], this->m_unwrappedFiles[windowBegin + fileNo]);
+		});
+
+		{
+			std::lock_guard<std::mutex> lock(this->m_mutex);
+			this->m_unwrappedCount = windowEnd;
+		}
+		this->m_fileUnwrapped.notify_all();
+	}
+}
+
+/*private*/ void FileKeyUnwrapper::Unwrap(const EncryptedFileEntry& entry, UnwrappedFile& unwrappedFile) const
+{
+	try
+	{
+		// collect information about the file to be decrypted, the file is
+		// mapped into memory once and used for the header and the file data;
+		// the header of an index is only used if the file didn't change since
+		{
+			StageTimer timer(Stage::HeaderParse);
+			unwrappedFile.fileData.reset(new FileData());
+			if (!this->m_isMapped)
+			{
+				this->ReadHeader(entry, unwrappedFile);
+			}
+			else
+			{
+				unwrappedFile.encryptedFile.reset(new MappedFile(entry.encryptedFilePath));
+				unwrappedFile.encryptedFileSize = unwrappedFile.encryptedFile->GetSize();
+				if (entry.indexEntry != nullptr && HeaderIndex::IsCurrent(*entry.indexEntry, unwrappedFile.encryptedFileSize))
+				{
+					unwrappedFile.fileData->LoadHeader(*entry.indexEntry);
+				}
+				else
+				{
+					unwrappedFile.fileData->ParseHeader(*unwrappedFile.encryptedFile, true);
+				}
+			}
+		}
+
+		// decrypt the file key (from file header) used for decryption of file data
+		std::vector<byte> decryptedFileKey;
+		{
+			StageTimer timer(Stage::RSAUnwrap);
+			this->DecryptFileKey(*unwrappedFile.fileData, decryptedFileKey);
+		}
+		unwrappedFile.fileCryptoKey.assign(decryptedFileKey.begin() + 32, decryptedFileKey.begin() + 64);
+	}
+	catch (...)
+	{
+		unwrappedFile.encryptedFile.reset();
+		unwrappedFile.error = std::current_exception();
+	}
+}
+
+// without mapping, only the raw and the core header are read with pread, so with direct I/O
+// the headers don't go through the page cache either; the reads start at the beginning of the
+// file and are rounded up to the alignment, which the pooled buffers of a page or more have
+/*private*/ void FileKeyUnwrapper::ReadHeader(const EncryptedFileEntry& entry, UnwrappedFile& unwrappedFile) const
+{
+#ifdef _WIN32
+	(void)entry;
+	(void)unwrappedFile;
+	throw std::runtime_error("Reading files without mapping them is not supported on this platform");
+#else
+	int directFlag = 0;
+#ifdef O_DIRECT
+	directFlag = this->m_isDirectIO ? O_DIRECT : 0;
+#endif
+	int file = open(entry.encryptedFilePath.c_str(), O_RDONLY | directFlag);
+	if (file < 0 && directFlag != 0 && errno == EINVAL)
+	{
+		file = open(entry.encryptedFilePath.c_str(), O_RDONLY);
+	}
+	struct stat fileStatus;
+	if (file < 0 || fstat(file, &fileStatus) != 0)
+	{
+		if (file >= 0)
+		{
+			close(file);
+		}
+		std::string errorMsg("Encrypted file (" + entry.encryptedFilePath + ") can't be opened (make sure the provided path is correct, the file exists and you have the right to open the file)");
+		throw std::runtime_error(errorMsg.c_str());
+	}
+	unwrappedFile.encryptedFileSize = static_cast<unsigned long long>(fileStatus.st_size);
+	bool isDirectInput = directFlag != 0 && (fcntl(file, F_GETFL) & directFlag) != 0;
+
+	try
+	{
+		if (entry.indexEntry != nullptr && HeaderIndex::IsCurrent(*entry.indexEntry, unwrappedFile.encryptedFileSize))
+		{
+			unwrappedFile.fileData->LoadHeader(*entry.indexEntry);
+			close(file);
+			return;
+		}
+
+		// reads the first [len] bytes of the file (fewer at its end) into [buffer]
+		const size_t alignment = AsyncIO::BufferAlignment;
+		PooledBuffer buffer;
+		size_t readLen = 0;
+		auto readFront = [&](size_t len)
+		{
+			len = static_cast<size_t>(std::min<unsigned long long>(len, unwrappedFile.encryptedFileSize));
+			size_t bufferLen = (len + alignment - 1) / alignment * alignment;
+			buffer = BufferPool::Get().Acquire(std::max(bufferLen, alignment));
+			readLen = 0;
+			while (readLen < len)
+			{
+				size_t requestLen = isDirectInput ? bufferLen - readLen : len - readLen;
+				ssize_t result = pread(file, buffer.GetData() + readLen, requestLen, static_cast<off_t>(readLen));
+				if (result < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				if (result <= 0)
+				{
+					throw std::runtime_error("Header of encrypted file (" + entry.encryptedFilePath + ") could not be read");
+				}
+				readLen += static_cast<size_t>(result);
+			}
+			readLen = std::min(readLen, len);
+		};
+
+		// the core header is a few hundred bytes per file key, so the first read almost
+		// always covers it; a bigger one is read again
+		readFront(FileKeyUnwrapper::HeaderReadLen);
+		if (readLen >= FileData::RawHeaderLen)
+		{
+			unsigned long long headerLen = FileData::GetParsedHeaderLen(buffer.GetData());
+			if (headerLen > readLen && readLen < unwrappedFile.encryptedFileSize)
+			{
+				readFront(static_cast<size_t>(headerLen));
+			}
+		}
+		unwrappedFile.fileData->ParseHeader(entry.encryptedFilePath, buffer.GetData(), readLen, true);
+	}
+	catch (const std::exception&)
+	{
+		close(file);
+		throw;
+	}
+	close(file);
+#endif
+}
+
+// a file shared with several users has a file key for each of them, the one with the id of
+// the account's user is decrypted; if none has it (e.g. the key was encrypted for a group),
+// each entry is tried until one can be decrypted with the private key
+/*private*/ void FileKeyUnwrapper::DecryptFileKey(const FileData& fileData, std::vector<byte>& decryptedFileKey) const
+{
+	const std::vector<EncryptedFileKey>& fileKeys = fileData.GetEncryptedFileKeys();
+	std::vector<const EncryptedFileKey *> candidates;
+	for (const auto& fileKey : fileKeys)
+	{
+		if (fileKey.id == this->m_userId)
+		{
+			candidates.push_back(&fileKey);
+		}
+	}
+	if (candidates.empty())
+	{
+		for (const auto& fileKey : fileKeys)
+		{
+			candidates.push_back(&fileKey);
+		}
+	}
+	if (candidates.empty())
+	{
+		throw std::runtime_error("File header contains no encrypted file key");
+	}
+
+	// the error of the last entry is reported if none of them fits
+	for (size_t candidateNo = 0; candidateNo < candidates.size(); ++candidateNo)
+	{
+		try
+		{
+			RSAHelper::DecryptData(candidates[candidateNo]->value, this->m_privateKey, decryptedFileKey, true);
+			if (decryptedFileKey.size() < 64)
+			{
+				throw std::runtime_error("Decrypted file key is too short, make sure the file is not corrupted");
+			}
+			return;
+		}
+		catch (const std::exception&)
+		{
+			if (candidateNo + 1 == candidates.size())
+			{
+				throw;
+			}
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef FILEKEYUNWRAPPER_H
+#define FILEKEYUNWRAPPER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TypeDefs.h"
+#include "FileCollector.h"
+#include "FileData.h"
+#include "MappedFile.h"
+#include "RSAPrivateKey.h"
+
+// an encrypted file whose header was parsed and whose file key was unwrapped,
+// [error] is set instead if one of these steps failed; the file is only mapped
+// if the run decrypts mapped files
+struct UnwrappedFile
+{
+	std::unique_ptr<MappedFile> encryptedFile;
+	unsigned long long encryptedFileSize = 0;
+	std::unique_ptr<FileData> fileData;
+	std::vector<byte> fileCryptoKey;
+	std::exception_ptr error;
+};
+
+// maps the encrypted files, parses their headers and unwraps their file keys with the private
+// RSA key ahead of the file decryption: a background thread works through the files in windows
+// of [threadCount] files, which are unwrapped in parallel on its own thread pool, so the RSA
+// decryption of the next files overlaps with the AES decryption of the current one; at most
+// [maxPendingFiles] unwrapped files wait for the decryption at once; the file key is taken from
+// the entry of the header which belongs to the user [userId] of the private key; unless
+// [isMapped], the headers are read like the file bodies, with direct I/O if [isDirectIO]
+class FileKeyUnwrapper
+{
+public:
+	FileKeyUnwrapper(
+		const std::vector<EncryptedFileEntry>& files, const RSAPrivateKey& privateKey, const std::string& userId,
+		unsigned int threadCount, size_t maxPendingFiles, bool isMapped = true, bool isDirectIO = false);
+	~FileKeyUnwrapper();
+
+	FileKeyUnwrapper(const FileKeyUnwrapper&) = delete;
+	FileKeyUnwrapper& operator=(const FileKeyUnwrapper&) = delete;
+
+	// waits until the next file (in the order of the list) is unwrapped and hands it over,
+	// must not be called more often than there are files
+	UnwrappedFile Next();
+
+private:
+	const std::vector<EncryptedFileEntry>& m_files;
+	const RSAPrivateKey& m_privateKey;
+	std::string m_userId;
+	unsigned int m_threadCount;
+	size_t m_maxPendingFiles;
+	bool m_isMapped;
+	bool m_isDirectIO;
+	std::vector<UnwrappedFile> m_unwrappedFiles;
+	std::mutex m_mutex;
+	std::condition_variable m_fileUnwrapped;
+	std::condition_variable m_fileTaken;
+	size_t m_unwrappedCount = 0;
+	size_t m_takenCount = 0;
+	bool m_stop = false;
+	std::thread m_worker;
+
+	// bytes read for the header of a file which isn't mapped
+	static const size_t HeaderReadLen = 64 * 1024;
+
+	void WorkerLoop();
+	void Unwrap(const EncryptedFileEntry& entry, UnwrappedFile& unwrappedFile) const;
+	void ReadHeader(const EncryptedFileEntry& entry, UnwrappedFile& unwrappedFile) const;
+	void DecryptFileKey(const FileData& fileData, std::vector<byte>& decryptedFileKey) const;
+};
+
+#endif
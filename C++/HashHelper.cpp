@@ -1,6 +1,6 @@
-#include <iostream>
 #include <stdexcept>
 #include "HashHelper.h"
+#include "Log.h"
 #include "sha.h"
 #include "hmac.h"
 #include "filters.h"
@@ -9,7 +9,7 @@ bool HashHelper::ComputeSHA256HMAC(const std::vector<byte>& data, const std::vec
 {
 	if (!silent)
 	{
-		std::cout << "Computation of HMAC-SHA-256 hash with " << data.size() << " bytes started" << std::endl;
+		LOG_DEBUG("Computation of HMAC-SHA-256 hash with " << data.size() << " bytes started");
 	}
 
 	// check if there is data to hash
@@ -31,13 +31,13 @@ bool HashHelper::ComputeSHA256HMAC(const std::vector<byte>& data, const std::vec
 		}
 		catch (const std::exception&)
 		{
-			std::cerr << "Computation of HMAC-SHA-256 failed" << std::endl;
+			LOG_ERROR("Computation of HMAC-SHA-256 failed");
 			throw;
 		}
 
 		if (!silent)
 		{
-			std::cout << "HMAC-SHA-256 computation finished" << std::endl;
+			LOG_DEBUG("HMAC-SHA-256 computation finished");
 		}
 		return true;
 	}
@@ -51,7 +51,7 @@ bool HashHelper::ComputeSHA512HMAC(const std::vector<byte>& data, const std::vec
 {
 	if (!silent)
 	{
-		std::cout << "Computation of HMAC-SHA-512 hash with " << data.size() << " bytes started" << std::endl;
+		LOG_DEBUG("Computation of HMAC-SHA-512 hash with " << data.size() << " bytes started");
 	}
 
 	// check if there is data to hash 
@@ -73,13 +73,13 @@ bool HashHelper::ComputeSHA512HMAC(const std::vector<byte>& data, const std::vec
 		}
 		catch (const std::exception&)
 		{
-			std::cerr << "Computation of HMAC-SHA-512 failed" << std::endl;
+			LOG_ERROR("Computation of HMAC-SHA-512 failed");
 			throw;
 		}
 
 		if (!silent)
 		{
-			std::cout << "HMAC-SHA-512 computation finished" << std::endl;
+			LOG_DEBUG("HMAC-SHA-512 computation finished");
 		}
 		return true;
 	}
@@ -0,0 +1,332 @@
+#include "HeaderIndex.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include "JSONReader.h"
+#include "MappedFile.h"
+#include "RunStatistics.h"
+#include "ThreadPool.h"
+#include "Log.h"
+
+namespace fs = std::filesystem;
+
+// writes [value] as JSON string, paths may contain backslashes and control characters
+static void WriteJSONString(std::ostream& output, const std::string& value)
+{
+	static const char hexDigits[] = "0123456789abcdef";
+	output << '"';
+	for (char c : value)
+	{
+		if (c == '"' || c == '\\')
+		{
+			output << '\\' << c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20)
+		{
+			output << "\\u00" << hexDigits[(c >> 4) & 0xf] << hexDigits[c & 0xf];
+		}
+		else
+		{
+			output << c;
+		}
+	}
+	output << '"';
+}
+
+void HeaderIndex::Build(const std::vector<EncryptedFileEntry>& files, const std::string& rootPath, unsigned int threadCount)
+{
+	// the paths are stored absolute, so the index can be used from any working directory
+	this->m_rootPath = rootPath.empty() ? rootPath : HeaderIndex::GetAbsolutePath(rootPath);
+	this->m_entries.assign(files.size(), HeaderIndexEntry());
+	std::vector<std::exception_ptr> errors(files.size());
+
+	// only the raw and the core header of each file are read from the mapping
+	ThreadPool threadPool(threadCount);
+	threadPool.ParallelFor(files.size(), [&](size_t fileNo)
+	{
+		HeaderIndexEntry& entry = this->m_entries[fileNo];
+		try
+		{
+			StageTimer timer(Stage::HeaderParse);
+			MappedFile encryptedFile(files[fileNo].encryptedFilePath);
+			FileData fileData;
+			fileData.ParseHeader(encryptedFile, true);
+
+			entry.encryptedFilePath = HeaderIndex::GetAbsolutePath(files[fileNo].encryptedFilePath);
+			entry.modificationTime = HeaderIndex::GetModificationTime(entry.encryptedFilePath);
+			entry.ciphertextSize = encryptedFile.GetSize();
+			entry.headerData = fileData.GetHeaderData();
+			entry.blockSize = fileData.GetBlockSize();
+			entry.baseIVec = fileData.GetBaseIVec();
+			entry.fileKeys = fileData.GetEncryptedFileKeys();
+
+			// like the decryption, the cipher padding length of the raw header is only taken as
+			// flag, the real length is in the PKCS7 bytes of the last block, which isn't decrypted
+			// here; at least one byte of a padded file is padding
+			unsigned long long cipherLen = entry.ciphertextSize - std::min<unsigned long long>(entry.ciphertextSize, fileData.GetHeaderLen());
+			entry.maxPlaintextSize = cipherLen - (entry.headerData.cipherPaddingLen > 0 && cipherLen > 0 ? 1 : 0);
+		}
+		catch (...)
+		{
+			errors[fileNo] = std::current_exception();
+		}
+	});
+
+	// the failed files are reported in the order of the list and left out of the index
+	size_t entryCount = 0;
+	for (size_t fileNo = 0; fileNo < files.size(); ++fileNo)
+	{
+		if (errors[fileNo])
+		{
+			try { std::rethrow_exception(errors[fileNo]); }
+			catch (const std::exception& e)
+			{
+				LOG_ERROR("Header of file '" << files[fileNo].encryptedFilePath << "' could not be indexed: " << e.what());
+			}
+			continue;
+		}
+		if (entryCount != fileNo)
+		{
+			this->m_entries[entryCount] = std::move(this->m_entries[fileNo]);
+		}
+		++entryCount;
+	}
+	this->m_entries.resize(entryCount);
+}
+
+// the index is written to a temporary file first, so an interrupted run doesn't leave
+// a truncated index behind
+void HeaderIndex::Write(const std::string& indexPath) const
+{
+	// the ids of the file keys repeat for every file, the entries refer to them by position
+	std::vector<const std::string *> keyIds;
+	std::map<std::string, size_t> keyIdPositions;
+	for (const auto& entry : this->m_entries)
+	{
+		for (const auto& fileKey : entry.fileKeys)
+		{
+			if (keyIdPositions.emplace(fileKey.id, keyIds.size()).second)
+			{
+				keyIds.push_back(&fileKey.id);
+			}
+		}
+	}
+
+	std::string temporaryPath = indexPath + ".tmp";
+	{
+		std::ofstream index(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!index.good())
+		{
+			throw std::runtime_error("Index (" + indexPath + ") can't be written (make sure the directory exists and you have the right to write to it)");
+		}
+
+		index << "{\"version\":" << HeaderIndex::FormatVersion << ",\"root\":";
+		WriteJSONString(index, this->m_rootPath);
+		index << ",\"keyIds\":[";
+		for (size_t i = 0; i < keyIds.size(); ++i)
+		{
+			index << (i > 0 ? "," : "");
+			WriteJSONString(index, *keyIds[i]);
+		}
+		index << "],\"files\":[\n";
+
+		for (size_t entryNo = 0; entryNo < this->m_entries.size(); ++entryNo)
+		{
+			const HeaderIndexEntry& entry = this->m_entries[entryNo];
+			index << "{\"path\":";
+			WriteJSONString(index, entry.encryptedFilePath);
+			index << ",\"mtime\":" << entry.modificationTime
+				<< ",\"size\":" << entry.ciphertextSize
+				<< ",\"maxPlaintextSize\":" << entry.maxPlaintextSize
+				<< ",\"coreLen\":" << entry.headerData.coreLen
+				<< ",\"corePaddingLen\":" << entry.headerData.corePaddingLen
+				<< ",\"cipherPaddingLen\":" << entry.headerData.cipherPaddingLen
+				<< ",\"blockSize\":" << entry.blockSize
+				<< ",\"iv\":";
+			WriteJSONString(index, entry.baseIVec);
+			index << ",\"fileKeys\":[";
+			for (size_t keyNo = 0; keyNo < entry.fileKeys.size(); ++keyNo)
+			{
+				index << (keyNo > 0 ? "," : "") << "{\"type\":";
+				WriteJSONString(index, entry.fileKeys[keyNo].type);
+				index << ",\"keyId\":" << keyIdPositions[entry.fileKeys[keyNo].id] << ",\"value\":";
+				WriteJSONString(index, entry.fileKeys[keyNo].value);
+				index << "}";
+			}
+			index << "]}" << (entryNo + 1 < this->m_entries.size() ? "," : "") << "\n";
+		}
+		index << "]}\n";
+
+		if (!index.good())
+		{
+			index.close();
+			std::remove(temporaryPath.c_str());
+			throw std::runtime_error("Index (" + indexPath + ") could not be written completely");
+		}
+	}
+
+	std::error_code error;
+	fs::rename(temporaryPath, indexPath, error);
+	if (error)
+	{
+		std::remove(temporaryPath.c_str());
+		throw std::runtime_error("Index (" + indexPath + ") could not be replaced: " + error.message());
+	}
+}
+
+void HeaderIndex::Load(const std::string& indexPath)
+{
+	std::ifstream indexFile(indexPath, std::ios::binary | std::ios::ate);
+	if (!indexFile.good())
+	{
+		std::string errorMsg("Index (" + indexPath + ") can't be opened (make sure the provided path is correct, the file exists and you have the right to open the file)");
+		throw std::runtime_error(errorMsg.c_str());
+	}
+
+	std::string indexData;
+	indexData.resize(static_cast<size_t>(indexFile.tellg()));
+	indexFile.seekg(0, std::ios::beg);
+	indexFile.read(&indexData[0], indexData.size());
+
+	this->m_entries.clear();
+	this->m_rootPath.clear();
+	try
+	{
+		JSONReader reader(indexData);
+		std::vector<std::string> keyIds;
+		std::string_view name;
+		unsigned long long version = 0;
+		auto readUInt = [&reader]
+		{
+			unsigned long long value = reader.ReadUnsignedInteger();
+			if (value > std::numeric_limits<unsigned int>::max())
+			{
+				throw std::runtime_error("value too big");
+			}
+			return static_cast<unsigned int>(value);
+		};
+
+		reader.BeginObject();
+		while (reader.NextMember(name))
+		{
+			if (name == "version")
+			{
+				version = reader.ReadUnsignedInteger();
+				if (version != HeaderIndex::FormatVersion)
+				{
+					throw std::runtime_error("unsupported index version " + std::to_string(version) + " (build the index again)");
+				}
+			}
+			else if (name == "root") { this->m_rootPath = reader.ReadString(); }
+			else if (name == "keyIds")
+			{
+				reader.BeginArray();
+				while (reader.NextElement())
+				{
+					keyIds.emplace_back(reader.ReadString());
+				}
+			}
+			else if (name == "files")
+			{
+				reader.BeginArray();
+				while (reader.NextElement())
+				{
+					HeaderIndexEntry entry;
+					reader.BeginObject();
+					while (reader.NextMember(name))
+					{
+						if (name == "path") { entry.encryptedFilePath = reader.ReadString(); }
+						else if (name == "mtime") { entry.modificationTime = reader.ReadInteger(); }
+						else if (name == "size") { entry.ciphertextSize = reader.ReadUnsignedInteger(); }
+						else if (name == "maxPlaintextSize") { entry.maxPlaintextSize = reader.ReadUnsignedInteger(); }
+						else if (name == "coreLen") { entry.headerData.coreLen = readUInt(); }
+						else if (name == "corePaddingLen") { entry.headerData.corePaddingLen = readUInt(); }
+						else if (name == "cipherPaddingLen") { entry.headerData.cipherPaddingLen = readUInt(); }
+						else if (name == "blockSize") { entry.blockSize = readUInt(); }
+						else if (name == "iv") { entry.baseIVec = reader.ReadString(); }
+						else if (name == "fileKeys")
+						{
+							reader.BeginArray();
+							while (reader.NextElement())
+							{
+								EncryptedFileKey fileKey;
+								reader.BeginObject();
+								while (reader.NextMember(name))
+								{
+									if (name == "type") { fileKey.type = reader.ReadString(); }
+									else if (name == "keyId")
+									{
+										// the ids are listed in front of the files
+										fileKey.id = keyIds.at(reader.ReadUnsignedInteger());
+									}
+									else if (name == "value") { fileKey.value = reader.ReadString(); }
+									else { reader.SkipValue(); }
+								}
+								entry.fileKeys.push_back(std::move(fileKey));
+							}
+						}
+						else { reader.SkipValue(); }
+					}
+
+					if (entry.encryptedFilePath.empty() || entry.blockSize == 0 || entry.baseIVec.empty() || entry.fileKeys.empty())
+					{
+						throw std::runtime_error("incomplete entry for file '" + entry.encryptedFilePath + "'");
+					}
+					this->m_entries.push_back(std::move(entry));
+				}
+			}
+			else { reader.SkipValue(); }
+		}
+
+		if (version == 0)
+		{
+			throw std::runtime_error("index version missing");
+		}
+	}
+	catch (const std::exception& e)
+	{
+		this->m_entries.clear();
+		throw std::runtime_error("Index (" + indexPath + ") could not be read: " + e.what());
+	}
+}
+
+const std::vector<HeaderIndexEntry>& HeaderIndex::GetEntries() const
+{
+	return this->m_entries;
+}
+
+std::string HeaderIndex::GetRootPath() const
+{
+	return this->m_rootPath;
+}
+
+bool HeaderIndex::IsCurrent(const HeaderIndexEntry& entry, unsigned long long fileSize)
+{
+	return entry.ciphertextSize == fileSize && entry.modificationTime != 0 && entry.modificationTime == HeaderIndex::GetModificationTime(entry.encryptedFilePath);
+}
+
+// 0 if the time can't be determined, an index entry with it is never current then
+long long HeaderIndex::GetModificationTime(const std::string& filePath)
+{
+	std::error_code error;
+	fs::file_time_type modificationTime = fs::last_write_time(filePath, error);
+	if (error)
+	{
+		return 0;
+	}
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(modificationTime.time_since_epoch()).count();
+}
+
+// the path stays as it is if the working directory can't be determined
+/*private*/ std::string HeaderIndex::GetAbsolutePath(const std::string& path)
+{
+	std::error_code error;
+	fs::path absolutePath = fs::absolute(path, error);
+	return error ? path : absolutePath.lexically_normal().string();
+}
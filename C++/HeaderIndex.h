@@ -0,0 +1,59 @@
+#ifndef HEADERINDEX_H
+#define HEADERINDEX_H
+
+#include <string>
+#include <vector>
+#include "FileCollector.h"
+#include "FileData.h"
+
+// everything the decryption needs from the header of an encrypted file, together with the
+// size and modification time the file had when the index was built; the modification time
+// is given in nanoseconds of the clock of the file system; the plaintext size is an upper
+// bound, as the length of the padding is only known once the last block is decrypted
+struct HeaderIndexEntry
+{
+	std::string encryptedFilePath;
+	long long modificationTime = 0;
+	unsigned long long ciphertextSize = 0;
+	unsigned long long maxPlaintextSize = 0;
+	HeaderData headerData;
+	unsigned int blockSize = 0;
+	std::string baseIVec;
+	std::vector<EncryptedFileKey> fileKeys;
+};
+
+// an index of the headers of many encrypted files, so later runs can plan their work (sizes,
+// block sizes, needed keys) without opening every file; the index is stored as JSON with
+// one line per file and the ids of the file keys are only stored once
+class HeaderIndex
+{
+public:
+	HeaderIndex() = default;
+
+	HeaderIndex(const HeaderIndex&) = delete;
+	HeaderIndex& operator=(const HeaderIndex&) = delete;
+
+	// reads the headers of [files] on [threadCount] threads, files whose header can't be read
+	// are reported and left out; the output paths of later runs are relative to [rootPath];
+	// the paths of the files and the root are stored absolute
+	void Build(const std::vector<EncryptedFileEntry>& files, const std::string& rootPath, unsigned int threadCount);
+	void Write(const std::string& indexPath) const;
+	void Load(const std::string& indexPath);
+
+	const std::vector<HeaderIndexEntry>& GetEntries() const;
+	std::string GetRootPath() const;
+
+	// true if the file still has the size and modification time of [entry]
+	static bool IsCurrent(const HeaderIndexEntry& entry, unsigned long long fileSize);
+	static long long GetModificationTime(const std::string& filePath);
+
+private:
+	std::vector<HeaderIndexEntry> m_entries;
+	std::string m_rootPath;
+
+	static const unsigned long long FormatVersion = 2;
+
+	static std::string GetAbsolutePath(const std::string& path);
+};
+
+#endif
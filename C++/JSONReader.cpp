@@ -0,0 +1,389 @@
+#include "JSONReader.h"
+#include <limits>
+#include <stdexcept>
+
+JSONReader::JSONReader(std::string_view json)
+	: m_json(json)
+{
+}
+
+void JSONReader::BeginObject()
+{
+	this->Expect('{');
+	if (++this->m_depth > JSONReader::MaxDepth)
+	{
+		this->Fail("nesting too deep");
+	}
+	this->m_isFirstItem = true;
+}
+
+bool JSONReader::NextMember(std::string_view& name)
+{
+	if (!this->NextItem('}'))
+	{
+		return false;
+	}
+
+	name = this->ReadRawString(this->m_nameBuffer);
+	this->Expect(':');
+	return true;
+}
+
+void JSONReader::BeginArray()
+{
+	this->Expect('[');
+	if (++this->m_depth > JSONReader::MaxDepth)
+	{
+		this->Fail("nesting too deep");
+	}
+	this->m_isFirstItem = true;
+}
+
+bool JSONReader::NextElement()
+{
+	return this->NextItem(']');
+}
+
+std::string_view JSONReader::ReadString()
+{
+	return this->ReadRawString(this->m_stringBuffer);
+}
+
+unsigned long long JSONReader::ReadUnsignedInteger()
+{
+	this->SkipWhitespace();
+	size_t begin = this->m_pos;
+	unsigned long long value = 0;
+	while (this->m_pos < this->m_json.size() && this->m_json[this->m_pos] >= '0' && this->m_json[this->m_pos] <= '9')
+	{
+		unsigned int digit = static_cast<unsigned int>(this->m_json[this->m_pos] - '0');
+		if (value > (std::numeric_limits<unsigned long long>::max() - digit) / 10)
+		{
+			this->Fail("number too big");
+		}
+		value = value * 10 + digit;
+		++this->m_pos;
+	}
+
+	// JSON doesn't allow leading zeros
+	if (this->m_pos - begin > 1 && this->m_json[begin] == '0')
+	{
+		this->Fail("number with leading zero");
+	}
+	// fractions, exponents and signs are valid JSON, but not an unsigned integer
+	if (this->m_pos == begin || (this->m_pos < this->m_json.size() && std::string_view(".eE+-").find(this->m_json[this->m_pos]) != std::string_view::npos))
+	{
+		this->Fail("unsigned integer expected");
+	}
+	return value;
+}
+
+long long JSONReader::ReadInteger()
+{
+	bool isNegative = this->Peek() == '-';
+	this->m_pos += isNegative ? 1 : 0;
+
+	unsigned long long value = this->ReadUnsignedInteger();
+	unsigned long long maxValue = static_cast<unsigned long long>(std::numeric_limits<long long>::max());
+	if (value > maxValue + (isNegative ? 1 : 0))
+	{
+		this->Fail("number too big");
+	}
+	return isNegative ? static_cast<long long>(0 - value) : static_cast<long long>(value);
+}
+
+void JSONReader::SkipValue()
+{
+	std::string_view name;
+	switch (this->Peek())
+	{
+	case '{':
+		this->BeginObject();
+		while (this->NextMember(name))
+		{
+			this->SkipValue();
+		}
+		break;
+	case '[':
+		this->BeginArray();
+		while (this->NextElement())
+		{
+			this->SkipValue();
+		}
+		break;
+	case '"':
+		// a skipped string is never decoded
+		this->ReadRawString(this->m_stringBuffer);
+		break;
+	case 't':
+		this->SkipLiteral("true");
+		break;
+	case 'f':
+		this->SkipLiteral("false");
+		break;
+	case 'n':
+		this->SkipLiteral("null");
+		break;
+	default:
+		this->SkipNumber();
+		break;
+	}
+}
+
+size_t JSONReader::GetPosition() const
+{
+	return this->m_pos;
+}
+
+/*private*/ void JSONReader::SkipWhitespace()
+{
+	while (this->m_pos < this->m_json.size())
+	{
+		char c = this->m_json[this->m_pos];
+		if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+		{
+			break;
+		}
+		++this->m_pos;
+	}
+}
+
+// returns the next character which is not whitespace without consuming it
+/*private*/ char JSONReader::Peek()
+{
+	this->SkipWhitespace();
+	if (this->m_pos >= this->m_json.size())
+	{
+		this->Fail("unexpected end of document");
+	}
+	return this->m_json[this->m_pos];
+}
+
+/*private*/ void JSONReader::Expect(char expected)
+{
+	if (this->Peek() != expected)
+	{
+		this->Fail(std::string("'") + expected + "' expected");
+	}
+	++this->m_pos;
+}
+
+// consumes the separator in front of the next item of an object or array,
+// or the [closing] bracket if there are no more items
+/*private*/ bool JSONReader::NextItem(char closing)
+{
+	if (this->Peek() == closing)
+	{
+		++this->m_pos;
+		--this->m_depth;
+		this->m_isFirstItem = false;
+		return false;
+	}
+
+	if (!this->m_isFirstItem)
+	{
+		this->Expect(',');
+	}
+	this->m_isFirstItem = false;
+	return true;
+}
+
+// the view points into the document, unless the string contains
+// escape sequences, then it is decoded into [buffer]
+/*private*/ std::string_view JSONReader::ReadRawString(std::string& buffer)
+{
+	this->Expect('"');
+	size_t begin = this->m_pos;
+	const char *data = this->m_json.data();
+	size_t size = this->m_json.size();
+
+	// fast path: most strings (names, base64 values) contain no escape sequences
+	while (this->m_pos < size && data[this->m_pos] != '"' && data[this->m_pos] != '\\')
+	{
+		if (static_cast<unsigned char>(data[this->m_pos]) < 0x20)
+		{
+			this->Fail("control character in string");
+		}
+		++this->m_pos;
+	}
+	if (this->m_pos >= size)
+	{
+		this->Fail("unterminated string");
+	}
+	if (data[this->m_pos] == '"')
+	{
+		return this->m_json.substr(begin, this->m_pos++ - begin);
+	}
+
+	buffer.assign(data + begin, this->m_pos - begin);
+	while (true)
+	{
+		if (this->m_pos >= size)
+		{
+			this->Fail("unterminated string");
+		}
+
+		char c = data[this->m_pos];
+		if (c == '"')
+		{
+			++this->m_pos;
+			return buffer;
+		}
+		if (c == '\\')
+		{
+			this->DecodeEscape(buffer);
+			continue;
+		}
+		if (static_cast<unsigned char>(c) < 0x20)
+		{
+			this->Fail("control character in string");
+		}
+		buffer.push_back(c);
+		++this->m_pos;
+	}
+}
+
+// appends the character of the escape sequence at the current position to [buffer]
+/*private*/ void JSONReader::DecodeEscape(std::string& buffer)
+{
+	if (this->m_pos + 1 >= this->m_json.size())
+	{
+		this->Fail("unterminated string");
+	}
+	char c = this->m_json[this->m_pos + 1];
+	this->m_pos += 2;
+	switch (c)
+	{
+	case '"': buffer.push_back('"'); return;
+	case '\\': buffer.push_back('\\'); return;
+	case '/': buffer.push_back('/'); return;
+	case 'b': buffer.push_back('\b'); return;
+	case 'f': buffer.push_back('\f'); return;
+	case 'n': buffer.push_back('\n'); return;
+	case 'r': buffer.push_back('\r'); return;
+	case 't': buffer.push_back('\t'); return;
+	case 'u': break;
+	default: this->Fail("invalid escape sequence");
+	}
+
+	// characters outside of the basic multilingual plane are encoded as surrogate pair
+	unsigned int codePoint = this->ReadHex4();
+	if (codePoint >= 0xd800 && codePoint <= 0xdbff)
+	{
+		if (this->m_json.substr(this->m_pos, 2) != "\\u")
+		{
+			this->Fail("incomplete surrogate pair");
+		}
+		this->m_pos += 2;
+		unsigned int lowSurrogate = this->ReadHex4();
+		if (lowSurrogate < 0xdc00 || lowSurrogate > 0xdfff)
+		{
+			this->Fail("invalid surrogate pair");
+		}
+		codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (lowSurrogate - 0xdc00);
+	}
+	else if (codePoint >= 0xdc00 && codePoint <= 0xdfff)
+	{
+		this->Fail("invalid surrogate pair");
+	}
+
+	// the decoded string is UTF-8
+	if (codePoint < 0x80)
+	{
+		buffer.push_back(static_cast<char>(codePoint));
+	}
+	else if (codePoint < 0x800)
+	{
+		buffer.push_back(static_cast<char>(0xc0 | (codePoint >> 6)));
+		buffer.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+	}
+	else if (codePoint < 0x10000)
+	{
+		buffer.push_back(static_cast<char>(0xe0 | (codePoint >> 12)));
+		buffer.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f)));
+		buffer.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+	}
+	else
+	{
+		buffer.push_back(static_cast<char>(0xf0 | (codePoint >> 18)));
+		buffer.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3f)));
+		buffer.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3f)));
+		buffer.push_back(static_cast<char>(0x80 | (codePoint & 0x3f)));
+	}
+}
+
+/*private*/ unsigned int JSONReader::ReadHex4()
+{
+	if (this->m_pos + 4 > this->m_json.size())
+	{
+		this->Fail("unterminated string");
+	}
+
+	unsigned int value = 0;
+	for (size_t i = 0; i < 4; ++i)
+	{
+		char c = this->m_json[this->m_pos++];
+		value <<= 4;
+		if (c >= '0' && c <= '9') { value |= static_cast<unsigned int>(c - '0'); }
+		else if (c >= 'a' && c <= 'f') { value |= static_cast<unsigned int>(c - 'a' + 10); }
+		else if (c >= 'A' && c <= 'F') { value |= static_cast<unsigned int>(c - 'A' + 10); }
+		else { this->Fail("invalid unicode escape sequence"); }
+	}
+	return value;
+}
+
+/*private*/ void JSONReader::SkipLiteral(std::string_view literal)
+{
+	if (this->m_json.substr(this->m_pos, literal.size()) != literal)
+	{
+		this->Fail("unexpected character");
+	}
+	this->m_pos += literal.size();
+}
+
+// skips a number following the JSON grammar: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+/*private*/ void JSONReader::SkipNumber()
+{
+	auto skipDigits = [this]
+	{
+		size_t begin = this->m_pos;
+		while (this->m_pos < this->m_json.size() && this->m_json[this->m_pos] >= '0' && this->m_json[this->m_pos] <= '9')
+		{
+			++this->m_pos;
+		}
+		if (this->m_pos == begin)
+		{
+			this->Fail("unexpected character");
+		}
+	};
+	auto skipIf = [this](const char *characters)
+	{
+		bool isMatch = this->m_pos < this->m_json.size() && std::string_view(characters).find(this->m_json[this->m_pos]) != std::string_view::npos;
+		this->m_pos += isMatch ? 1 : 0;
+		return isMatch;
+	};
+
+	skipIf("-");
+	if (!skipIf("0"))
+	{
+		skipDigits();
+	}
+	else if (this->m_pos < this->m_json.size() && this->m_json[this->m_pos] >= '0' && this->m_json[this->m_pos] <= '9')
+	{
+		this->Fail("number with leading zero");
+	}
+	if (skipIf("."))
+	{
+		skipDigits();
+	}
+	if (skipIf("eE"))
+	{
+		skipIf("+-");
+		skipDigits();
+	}
+}
+
+/*private*/ void JSONReader::Fail(const std::string& message) const
+{
+	throw std::runtime_error("Invalid JSON at offset " + std::to_string(this->m_pos) + ": " + message);
+}
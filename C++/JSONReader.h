@@ -0,0 +1,61 @@
+#ifndef JSONREADER_H
+#define JSONREADER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// reads a JSON document in a single pass from front to back without copying it: objects are
+// read with BeginObject and NextMember until it returns false, arrays with BeginArray and
+// NextElement, values which are not needed are skipped with SkipValue; strings are returned
+// as views into the document and only strings containing escape sequences are decoded into
+// an internal buffer; malformed documents result in an exception
+class JSONReader
+{
+public:
+	explicit JSONReader(std::string_view json);
+
+	JSONReader(const JSONReader&) = delete;
+	JSONReader& operator=(const JSONReader&) = delete;
+
+	void BeginObject();
+	// reads the name of the next member, the reader is positioned at its value then;
+	// [name] stays valid until the next member name is read
+	bool NextMember(std::string_view& name);
+
+	void BeginArray();
+	// the reader is positioned at the next element if true is returned
+	bool NextElement();
+
+	// the returned view stays valid until the next string value is read
+	std::string_view ReadString();
+	unsigned long long ReadUnsignedInteger();
+	long long ReadInteger();
+	void SkipValue();
+
+	// offset of the next character to read, used for error messages
+	size_t GetPosition() const;
+
+private:
+	std::string_view m_json;
+	size_t m_pos = 0;
+	bool m_isFirstItem = false;
+	unsigned int m_depth = 0;
+	std::string m_nameBuffer;
+	std::string m_stringBuffer;
+
+	static const unsigned int MaxDepth = 64;
+
+	void SkipWhitespace();
+	char Peek();
+	void Expect(char expected);
+	bool NextItem(char closing);
+	std::string_view ReadRawString(std::string& buffer);
+	void DecodeEscape(std::string& buffer);
+	unsigned int ReadHex4();
+	void SkipLiteral(std::string_view literal);
+	void SkipNumber();
+	[[noreturn]] void Fail(const std::string& message) const;
+};
+
+#endif
@@ -0,0 +1,178 @@
+#include "Log.h"
+#include <iostream>
+#include <utility>
+
+std::atomic<int> Log::s_level{ static_cast<int>(LogLevel::Info) };
+
+Log::~Log()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		this->m_stop = true;
+	}
+	this->m_messagesQueued.notify_all();
+
+	if (this->m_writer.joinable())
+	{
+		this->m_writer.join();
+	}
+}
+
+Log& Log::Get()
+{
+	static Log log;
+	return log;
+}
+
+void Log::SetLevel(LogLevel level)
+{
+	Log::s_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+bool Log::ParseLevel(const std::string& name, LogLevel& level)
+{
+	const char *names[] = { "debug", "info", "warning", "error", "off" };
+	for (int i = 0; i <= static_cast<int>(LogLevel::Off); ++i)
+	{
+		if (name == names[i])
+		{
+			level = static_cast<LogLevel>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+void Log::Write(LogLevel level, std::string text)
+{
+	this->Queue(level, MessageKind::Message, std::move(text));
+}
+
+void Log::WriteOutput(std::string text)
+{
+	this->Queue(LogLevel::Info, MessageKind::Output, std::move(text));
+}
+
+void Log::WriteStatus(std::string line)
+{
+	this->Queue(LogLevel::Info, MessageKind::Status, std::move(line));
+}
+
+void Log::EndStatus()
+{
+	this->Queue(LogLevel::Info, MessageKind::StatusEnd, std::string());
+}
+
+void Log::Flush()
+{
+	std::unique_lock<std::mutex> lock(this->m_mutex);
+	this->m_messagesWritten.wait(lock, [this] { return this->m_writtenCount == this->m_queuedCount; });
+}
+
+void Log::UseStandardError()
+{
+	this->m_isUsingStandardError = true;
+}
+
+bool Log::IsUsingStandardError() const
+{
+	return this->m_isUsingStandardError;
+}
+
+/*private*/ void Log::Queue(LogLevel level, MessageKind kind, std::string text)
+{
+	{
+		std::unique_lock<std::mutex> lock(this->m_mutex);
+
+		// the writer is only started by the first message, so a quiet run has no extra thread
+		if (!this->m_writer.joinable())
+		{
+			this->m_writer = std::thread(&Log::WriterLoop, this);
+		}
+
+		this->m_messagesWritten.wait(lock, [this] { return this->m_messages.size() < Log::MaxQueuedMessages; });
+		this->m_messages.push_back({ level, kind, std::move(text) });
+		++this->m_queuedCount;
+	}
+	this->m_messagesQueued.notify_one();
+}
+
+// takes all queued messages at once and writes them without holding the lock,
+// the queue is drained completely before the writer stops; only the latest status
+// line of a batch is drawn, it is erased with spaces, which works on every terminal
+/*private*/ void Log::WriterLoop()
+{
+	std::vector<Message> messages;
+	std::string status;
+	size_t shownStatusLen = 0;
+	std::unique_lock<std::mutex> lock(this->m_mutex);
+	while (true)
+	{
+		this->m_messagesQueued.wait(lock, [this] { return this->m_stop || !this->m_messages.empty(); });
+		std::ostream& output = this->m_isUsingStandardError ? std::cerr : std::cout;
+		if (this->m_messages.empty())
+		{
+			if (shownStatusLen > 0)
+			{
+				output << std::endl;
+			}
+			return;
+		}
+
+		messages.swap(this->m_messages);
+		lock.unlock();
+
+		bool isStatusChanged = false;
+		std::ostream *lastStream = &output;
+		for (Message& message : messages)
+		{
+			if (message.kind == MessageKind::Status)
+			{
+				status = std::move(message.text);
+				isStatusChanged = true;
+				continue;
+			}
+			if (message.kind == MessageKind::StatusEnd)
+			{
+				if (!status.empty())
+				{
+					output << '\r' << status << std::string(shownStatusLen > status.length() ? shownStatusLen - status.length() : 0, ' ') << '\n';
+				}
+				status.clear();
+				shownStatusLen = 0;
+				isStatusChanged = false;
+				continue;
+			}
+
+			if (shownStatusLen > 0)
+			{
+				output << '\r' << std::string(shownStatusLen, ' ') << '\r';
+				shownStatusLen = 0;
+			}
+
+			// the standard output is buffered, so it is flushed before something goes to the standard
+			// error output and the other way round, otherwise the messages could end up out of order
+			std::ostream& stream = message.kind == MessageKind::Message && message.level >= LogLevel::Warning ? std::cerr : output;
+			if (&stream != lastStream)
+			{
+				lastStream->flush();
+				lastStream = &stream;
+			}
+			stream << message.text;
+		}
+
+		if (!status.empty() && (isStatusChanged || shownStatusLen == 0))
+		{
+			lastStream->flush();
+			output << '\r' << status << std::string(shownStatusLen > status.length() ? shownStatusLen - status.length() : 0, ' ');
+			shownStatusLen = status.length();
+		}
+		output.flush();
+		std::cerr.flush();
+
+		lock.lock();
+		this->m_writtenCount += messages.size();
+		messages.clear();
+		this->m_messagesWritten.notify_all();
+	}
+}
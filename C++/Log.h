@@ -0,0 +1,122 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class LogLevel
+{
+	Debug,
+	Info,
+	Warning,
+	Error,
+	Off
+};
+
+// messages below this level are removed at compile time, e.g. -DLOG_MIN_LEVEL=1 drops all
+// debug messages including the formatting of their arguments
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+// the message is only formatted if its level is enabled, otherwise the check of the level
+// is all that is left of it; [message] is everything that can be put into a stream, e.g.
+// LOG_INFO("Decrypted " << count << " files"), LOG_WRITE doesn't end the line
+#define LOG_WRITE(level, message) \
+	do \
+	{ \
+		if (static_cast<int>(level) >= LOG_MIN_LEVEL && Log::IsEnabled(level)) \
+		{ \
+			std::ostringstream logStream; \
+			logStream << message; \
+			Log::Get().Write(level, logStream.str()); \
+		} \
+	} while (false)
+
+#define LOG_AT(level, message) LOG_WRITE(level, message << '\n')
+
+#define LOG_DEBUG(message) LOG_AT(LogLevel::Debug, message)
+#define LOG_INFO(message) LOG_AT(LogLevel::Info, message)
+#define LOG_WARNING(message) LOG_AT(LogLevel::Warning, message)
+#define LOG_ERROR(message) LOG_AT(LogLevel::Error, message)
+
+// collects the diagnostic messages of all threads and writes them on a thread of its own, so
+// logging never waits for the terminal: the messages are written in the order they were logged,
+// debug and info messages to the standard output, warnings and errors to the standard error
+// output, which are flushed once per batch of messages instead of once per line
+class Log
+{
+public:
+	Log(const Log&) = delete;
+	Log& operator=(const Log&) = delete;
+	~Log();
+
+	static Log& Get();
+
+	static bool IsEnabled(LogLevel level)
+	{
+		return static_cast<int>(level) >= Log::s_level.load(std::memory_order_relaxed);
+	}
+	static void SetLevel(LogLevel level);
+	// converts "debug", "info", "warning", "error" or "off", returns false for anything else
+	static bool ParseLevel(const std::string& name, LogLevel& level);
+
+	// queues [text] as it is (without adding a newline), waits if too many messages are queued
+	void Write(LogLevel level, std::string text);
+	// queues the output of the program itself (e.g. a listing), which is written to the standard
+	// output whatever the level is, but in order with the messages
+	void WriteOutput(std::string text);
+	// replaces the status line (e.g. a progress bar) at the bottom of a terminal, it is erased
+	// before other messages are written and drawn again below them; EndStatus leaves the last
+	// status line where it is and ends it
+	void WriteStatus(std::string line);
+	void EndStatus();
+	// waits until all queued messages are written
+	void Flush();
+	// writes everything to the standard error output, e.g. if the standard output carries data
+	void UseStandardError();
+	bool IsUsingStandardError() const;
+
+	static const size_t MaxQueuedMessages = 65536;
+
+private:
+	enum class MessageKind
+	{
+		Message,
+		Output,
+		Status,
+		StatusEnd
+	};
+
+	struct Message
+	{
+		LogLevel level;
+		MessageKind kind;
+		std::string text;
+	};
+
+	static std::atomic<int> s_level;
+
+	std::mutex m_mutex;
+	std::condition_variable m_messagesQueued;
+	std::condition_variable m_messagesWritten;
+	std::vector<Message> m_messages;
+	unsigned long long m_queuedCount = 0;
+	unsigned long long m_writtenCount = 0;
+	bool m_stop = false;
+	std::atomic<bool> m_isUsingStandardError{ false };
+	std::thread m_writer;
+
+	Log() = default;
+
+	void Queue(LogLevel level, MessageKind kind, std::string text);
+	void WriterLoop();
+};
+
+#endif
@@ -0,0 +1,124 @@
+#include "MappedFile.h"
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& filePath)
+	: m_filePath(filePath)
+{
+	std::string openErrorMsg("Encrypted file (" + filePath + ") can't be opened (make sure the provided path is correct, the file exists and you have the right to open the file)");
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error(openErrorMsg.c_str());
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		throw std::runtime_error(openErrorMsg.c_str());
+	}
+	this->m_size = static_cast<size_t>(fileSize.QuadPart);
+
+	// empty files can't be mapped, there is nothing to read anyway
+	if (this->m_size > 0)
+	{
+		// the view keeps the mapping alive, the handles are not needed anymore afterwards
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping != nullptr)
+		{
+			this->m_data = static_cast<const byte *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+#else
+	int file = open(filePath.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		throw std::runtime_error(openErrorMsg.c_str());
+	}
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || !S_ISREG(fileStat.st_mode))
+	{
+		close(file);
+		throw std::runtime_error(openErrorMsg.c_str());
+	}
+	this->m_size = static_cast<size_t>(fileStat.st_size);
+
+	// empty files can't be mapped, there is nothing to read anyway
+	if (this->m_size > 0)
+	{
+		// the mapping stays valid after the file descriptor is closed
+		void *data = mmap(nullptr, this->m_size, PROT_READ, MAP_PRIVATE, file, 0);
+		this->m_data = data != MAP_FAILED ? static_cast<const byte *>(data) : nullptr;
+	}
+	close(file);
+#endif
+
+	if (this->m_size > 0 && this->m_data == nullptr)
+	{
+		std::string errorMsg("Encrypted file (" + filePath + ") can't be mapped into memory");
+		throw std::runtime_error(errorMsg.c_str());
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (this->m_data != nullptr)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(this->m_data);
+#else
+		munmap(const_cast<byte *>(this->m_data), this->m_size);
+#endif
+	}
+}
+
+void MappedFile::AdviseSequential(size_t pos, size_t len) const
+{
+#ifndef _WIN32
+	if (this->m_data == nullptr || pos >= this->m_size)
+	{
+		return;
+	}
+
+	// madvise needs a page aligned address, so the range is extended to the start of its first page;
+	// the advice is only a hint, so it doesn't matter if the system ignores it
+	static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	size_t alignedPos = pos - pos % pageSize;
+	size_t alignedLen = std::min(len, this->m_size - pos) + (pos - alignedPos);
+	madvise(const_cast<byte *>(this->m_data) + alignedPos, alignedLen, MADV_SEQUENTIAL);
+#else
+	// the file was already opened with FILE_FLAG_SEQUENTIAL_SCAN
+	(void)pos;
+	(void)len;
+#endif
+}
+
+const byte *MappedFile::GetData() const
+{
+	return this->m_data;
+}
+
+size_t MappedFile::GetSize() const
+{
+	return this->m_size;
+}
+
+std::string MappedFile::GetFilePath() const
+{
+	return this->m_filePath;
+}
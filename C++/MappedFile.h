@@ -0,0 +1,34 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include "TypeDefs.h"
+
+// maps a complete file read-only into memory, so its content can be used directly from
+// the page cache without reading it into a buffer first; the mapping is released when
+// the object is destroyed
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string& filePath);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// tells the operating system that [len] bytes starting at [pos] will be read once
+	// from front to back, so pages are read ahead aggressively and can be dropped soon
+	void AdviseSequential(size_t pos, size_t len) const;
+
+	const byte *GetData() const;
+	size_t GetSize() const;
+	std::string GetFilePath() const;
+
+private:
+	std::string m_filePath;
+	const byte *m_data = nullptr;
+	size_t m_size = 0;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "OutputFile.h"
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+OutputFile::OutputFile(const std::string& filePath, size_t size)
+	: m_filePath(filePath), m_size(size)
+{
+	std::string createErrorMsg("Can't create decrypted file at location '" + filePath + "' (make sure you have the necessary file system rights to write to this location or specify another path)");
+	std::string allocateErrorMsg("Can't reserve " + std::to_string(size) + " bytes for decrypted file at location '" + filePath + "' (make sure there is enough free disk space)");
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error(createErrorMsg.c_str());
+	}
+	this->m_file = file;
+	this->m_isOpen = true;
+
+	LARGE_INTEGER fileSize;
+	fileSize.QuadPart = static_cast<LONGLONG>(size);
+	if (!SetFilePointerEx(file, fileSize, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+	{
+		CloseHandle(file);
+		throw std::runtime_error(allocateErrorMsg.c_str());
+	}
+
+	// empty files can't be mapped, there is nothing to write anyway
+	if (size > 0)
+	{
+		// the view keeps the mapping alive, the mapping handle is not needed anymore afterwards
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+		if (mapping != nullptr)
+		{
+			this->m_data = static_cast<byte *>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+			CloseHandle(mapping);
+		}
+	}
+#else
+	int file = open(filePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file < 0)
+	{
+		throw std::runtime_error(createErrorMsg.c_str());
+	}
+	this->m_file = file;
+	this->m_isOpen = true;
+
+	// reserve the blocks on disk, so a full disk is noticed now and not by a
+	// SIGBUS while writing to the mapping; not every file system supports this,
+	// in that case the file just gets its size
+	if (size > 0)
+	{
+		int result = posix_fallocate(file, 0, static_cast<off_t>(size));
+		if (result != 0 && (result == ENOSPC || ftruncate(file, static_cast<off_t>(size)) != 0))
+		{
+			close(file);
+			throw std::runtime_error(allocateErrorMsg.c_str());
+		}
+
+		void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		this->m_data = data != MAP_FAILED ? static_cast<byte *>(data) : nullptr;
+	}
+#endif
+
+	if (size > 0 && this->m_data == nullptr)
+	{
+#ifdef _WIN32
+		CloseHandle(file);
+#else
+		close(file);
+#endif
+		std::string errorMsg("Decrypted file at location '" + filePath + "' can't be mapped into memory");
+		throw std::runtime_error(errorMsg.c_str());
+	}
+}
+
+OutputFile::~OutputFile()
+{
+	if (this->m_isOpen)
+	{
+		this->Unmap();
+#ifdef _WIN32
+		CloseHandle(this->m_file);
+#else
+		close(this->m_file);
+#endif
+	}
+}
+
+void OutputFile::Close(size_t finalSize)
+{
+	if (!this->m_isOpen || finalSize > this->m_size)
+	{
+		throw std::runtime_error("Decrypted file can't be closed with a size bigger than the reserved one");
+	}
+
+	// the mapping is released, the file is cut to its final size and the data is written
+	// back to the disk before the file is closed, so a failed write (e.g. an I/O error or a
+	// full disk on a file system which couldn't reserve the space) is noticed here instead
+	// of being lost silently, the caller removes the partial file then
+	// the first step which fails gives the reason, the file is closed in any case
+	int error = this->Unmap() ? 0 : OutputFile::GetSystemError();
+	this->m_isOpen = false;
+
+#ifdef _WIN32
+	LARGE_INTEGER fileSize;
+	fileSize.QuadPart = static_cast<LONGLONG>(finalSize);
+	if (!(SetFilePointerEx(this->m_file, fileSize, nullptr, FILE_BEGIN) && SetEndOfFile(this->m_file)) && error == 0)
+	{
+		error = OutputFile::GetSystemError();
+	}
+	if (!FlushFileBuffers(this->m_file) && error == 0)
+	{
+		error = OutputFile::GetSystemError();
+	}
+	if (!CloseHandle(this->m_file) && error == 0)
+	{
+		error = OutputFile::GetSystemError();
+	}
+#else
+	if (finalSize != this->m_size && ftruncate(this->m_file, static_cast<off_t>(finalSize)) != 0 && error == 0)
+	{
+		error = OutputFile::GetSystemError();
+	}
+	if (fdatasync(this->m_file) != 0 && error == 0)
+	{
+		error = OutputFile::GetSystemError();
+	}
+	if (close(this->m_file) != 0 && error == 0)
+	{
+		error = OutputFile::GetSystemError();
+	}
+#endif
+
+	if (error != 0)
+	{
+		throw std::runtime_error("Decrypted file at location '" + this->m_filePath + "' could not be written completely (error " + std::to_string(error) + ")");
+	}
+}
+
+byte *OutputFile::GetData()
+{
+	return this->m_data;
+}
+
+size_t OutputFile::GetSize() const
+{
+	return this->m_size;
+}
+
+std::string OutputFile::GetFilePath() const
+{
+	return this->m_filePath;
+}
+
+// returns false if the mapping couldn't be released, e.g. because the data couldn't be written back
+/*private*/ bool OutputFile::Unmap()
+{
+	bool isUnmapped = true;
+	if (this->m_data != nullptr)
+	{
+#ifdef _WIN32
+		isUnmapped = FlushViewOfFile(this->m_data, 0) != 0 && UnmapViewOfFile(this->m_data) != 0;
+#else
+		isUnmapped = munmap(this->m_data, this->m_size) == 0;
+#endif
+		this->m_data = nullptr;
+	}
+	return isUnmapped;
+}
+
+/*private*/ int OutputFile::GetSystemError()
+{
+#ifdef _WIN32
+	return static_cast<int>(::GetLastError());
+#else
+	return errno != 0 ? errno : EIO;
+#endif
+}
@@ -0,0 +1,45 @@
+#ifndef OUTPUTFILE_H
+#define OUTPUTFILE_H
+
+#include <cstddef>
+#include <string>
+#include "TypeDefs.h"
+
+// creates a file of a known size, reserves the space on disk up front and maps it
+// writable into memory, so data can be placed directly at its final position; the
+// page cache writes the data back while the rest of the file is still being produced,
+// closing the file waits until all of it is on the disk
+class OutputFile
+{
+public:
+	OutputFile(const std::string& filePath, size_t size);
+	~OutputFile();
+
+	OutputFile(const OutputFile&) = delete;
+	OutputFile& operator=(const OutputFile&) = delete;
+
+	// releases the mapping, cuts the file to [finalSize] bytes, which must not be bigger
+	// than the size given on creation, and writes the data back to the disk; throws if any
+	// of this fails, as the file may be incomplete then
+	void Close(size_t finalSize);
+
+	byte *GetData();
+	size_t GetSize() const;
+	std::string GetFilePath() const;
+
+private:
+	std::string m_filePath;
+	byte *m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	void *m_file;
+#else
+	int m_file;
+#endif
+	bool m_isOpen = false;
+
+	bool Unmap();
+	static int GetSystemError();
+};
+
+#endif
@@ -1,6 +1,6 @@
-#include <iostream>
 #include <stdexcept>
 #include "PBKDF2Helper.h"
+#include "Log.h"
 #include "algparam.h"
 #include "pwdbased.h"
 #include "sha.h"
@@ -14,7 +14,7 @@ PBKDF2Helper::PBKDF2Helper(std::string pwd, std::vector<byte> salt, int iteratio
 
 bool PBKDF2Helper::GetBytes(unsigned int count, std::vector<byte>& derivedBytes)
 {
-	std::cout << "PBKDF2 algorithm to get " << count << " bytes started" << std::endl;
+	LOG_DEBUG("PBKDF2 algorithm to get " << count << " bytes started");
 
 	if (count > 0)
 	{
@@ -33,11 +33,11 @@ bool PBKDF2Helper::GetBytes(unsigned int count, std::vector<byte>& derivedBytes)
 		}
 		catch (const std::exception&)
 		{
-			std::cerr << "Could not derive bytes with PBKDF2" << std::endl;
+			LOG_ERROR("Could not derive bytes with PBKDF2");
 			throw;
 		}
 
-		std::cout << "PBKDF2 algorithm finished" << std::endl;
+		LOG_DEBUG("PBKDF2 algorithm finished");
 		return true;
 	}
 	else
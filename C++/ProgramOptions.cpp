@@ -0,0 +1,200 @@
+#include "ProgramOptions.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include "ThreadPool.h"
+
+const char *const ProgramOptions::StandardOutputPath = "-";
+
+// returns false if not all mandatory arguments were given,
+// invalid options and values result in an exception
+bool ProgramOptions::Parse(int argc, char *argv[])
+{
+	this->threadCount = ThreadPool::GetDefaultThreadCount();
+
+	std::vector<std::string> positionalArgs;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg(argv[i]);
+		if (arg.compare(0, 2, "--") != 0)
+		{
+			positionalArgs.push_back(arg);
+			continue;
+		}
+
+		// all options expect a value
+		if (i + 1 >= argc)
+		{
+			throw std::runtime_error("Missing value for option '" + arg + "'");
+		}
+		std::string value(argv[++i]);
+
+		if (arg == "--threads")
+		{
+			this->threadCount = ProgramOptions::ParseCount(value, arg);
+		}
+		else if (arg == "--rsa-validation")
+		{
+			// level 0 is allowed here, so the count parsing can't be used
+			if (value.length() != 1 || value[0] < '0' || value[0] > '3')
+			{
+				throw std::runtime_error("Value of option '" + arg + "' must be between 0 and 3");
+			}
+			this->rsaValidationLevel = static_cast<unsigned int>(value[0] - '0');
+		}
+		else if (arg == "--manifest")
+		{
+			this->manifestPath = value;
+		}
+		else if (arg == "--index")
+		{
+			this->indexPath = value;
+		}
+		else if (arg == "--build-index")
+		{
+			this->buildIndexPath = value;
+		}
+		else if (arg == "--list-index")
+		{
+			this->listIndexPath = value;
+		}
+		else if (arg == "--stats")
+		{
+			this->statsPath = value;
+		}
+		else if (arg == "--stats-interval")
+		{
+			this->statsInterval = ProgramOptions::ParseCount(value, arg);
+		}
+		else if (arg == "--io")
+		{
+			if (value != "mmap" && value != "uring" && value != "pread")
+			{
+				throw std::runtime_error("Value of option '" + arg + "' must be mmap, uring or pread");
+			}
+			this->ioMode = value;
+		}
+		else if (arg == "--direct-io")
+		{
+			if (value != "on" && value != "off")
+			{
+				throw std::runtime_error("Value of option '" + arg + "' must be on or off");
+			}
+			this->isDirectIO = value == "on";
+		}
+		else if (arg == "--huge-pages")
+		{
+			if (value != "on" && value != "off")
+			{
+				throw std::runtime_error("Value of option '" + arg + "' must be on or off");
+			}
+			this->useHugePages = value == "on";
+		}
+		else if (arg == "--progress")
+		{
+			if (value != "auto" && value != "bar" && value != "json" && value != "off")
+			{
+				throw std::runtime_error("Value of option '" + arg + "' must be auto, bar, json or off");
+			}
+			this->progressMode = value;
+		}
+		else if (arg == "--log-level")
+		{
+			if (!Log::ParseLevel(value, this->logLevel))
+			{
+				throw std::runtime_error("Value of option '" + arg + "' must be debug, info, warning, error or off");
+			}
+		}
+		else
+		{
+			throw std::runtime_error("Unknown option '" + arg + "'");
+		}
+	}
+
+	// mapped files always go through the page cache
+	if (this->isDirectIO && this->ioMode == "mmap")
+	{
+		this->ioMode = "uring";
+	}
+
+	if (this->listIndexPath.length() > 0)
+	{
+		return true;
+	}
+	if (this->buildIndexPath.length() > 0)
+	{
+		if (this->indexPath.length() > 0)
+		{
+			throw std::runtime_error("An index can't be built from another index");
+		}
+		this->encryptedFilePath = positionalArgs.size() > 0 ? positionalArgs.at(0) : "";
+		return this->manifestPath.length() > 0 || positionalArgs.size() > 0;
+	}
+
+	// the files listed in a manifest or an index replace the encrypted path
+	if (this->manifestPath.length() > 0 || this->indexPath.length() > 0)
+	{
+		positionalArgs.insert(positionalArgs.begin() + std::min<size_t>(1, positionalArgs.size()), "");
+	}
+
+	if (positionalArgs.size() < 3)
+	{
+		return false;
+	}
+
+	this->keyfilePath = positionalArgs.at(0);
+	this->encryptedFilePath = positionalArgs.at(1);
+	this->password = positionalArgs.at(2);
+	this->outputFilePath = positionalArgs.size() > 3 ? positionalArgs.at(3) : "";
+	if (this->outputFilePath == ProgramOptions::StandardOutputPath && (this->manifestPath.length() > 0 || this->indexPath.length() > 0))
+	{
+		throw std::runtime_error("Only a single file can be decrypted to the standard output");
+	}
+	return true;
+}
+
+void ProgramOptions::PrintUsage()
+{
+	std::cout << "Usage: bc-file-decryptor.exe "
+		<< "[options] "
+		<< "[path to .bckey file] "
+		<< "[path to encrypted file or directory] "
+		<< "[pwd] "
+		<< "[path for output (optional, \"-\" for the standard output)] "
+		<< std::endl
+		<< "Options:" << std::endl
+		<< "  --threads [count]         number of threads used for decryption (default: number of cores)" << std::endl
+		<< "  --rsa-validation [level]  validation level (0 - 3) of the private RSA key (default: 3)" << std::endl
+		<< "  --manifest [path]         decrypt the files and directories listed in this file (one per line)," << std::endl
+		<< "                            the path to the encrypted file has to be left out then" << std::endl
+		<< "  --index [path]            decrypt the files of this header index, the path to the encrypted file" << std::endl
+		<< "                            has to be left out then" << std::endl
+		<< "  --build-index [path]      only read the headers of the encrypted files and write them to this index," << std::endl
+		<< "                            the path to the encrypted file or directory (or --manifest) is all that is needed" << std::endl
+		<< "  --list-index [path]       list the files of this index with their sizes and keys, nothing else is needed" << std::endl
+		<< "  --stats [path]            write statistics of the run as JSON to this file (\"-\" for the standard output)" << std::endl
+		<< "  --stats-interval [secs]   additionally write the statistics periodically during the run" << std::endl
+		<< "  --io [mode]               how files are read and written: mmap (default), uring (many reads and" << std::endl
+		<< "                            writes in flight, falls back to pread if io_uring is not available) or pread" << std::endl
+		<< "  --direct-io [on|off]      read and write the files (headers included) without the page cache (default: off)," << std::endl
+		<< "                            uses uring unless --io pread is given" << std::endl
+		<< "  --huge-pages [on|off]     back buffers of 2 MB or more with huge pages (default: off)" << std::endl
+		<< "  --progress [mode]         how the progress is shown: auto (default, a bar on a terminal), bar," << std::endl
+		<< "                            json (one object per line on the standard output) or off" << std::endl
+		<< "  --log-level [level]       messages shown: debug, info (default), warning, error or off" << std::endl;
+}
+
+// converts the value of an option to a number bigger than zero
+/*private*/ unsigned int ProgramOptions::ParseCount(const std::string& value, const std::string& option)
+{
+	int count = 0;
+	try { count = std::stoi(value); }
+	catch (...) { throw std::runtime_error("Could not convert value of option '" + option + "' to integer"); }
+
+	if (count <= 0)
+	{
+		throw std::runtime_error("Value of option '" + option + "' must be bigger than zero");
+	}
+	return static_cast<unsigned int>(count);
+}
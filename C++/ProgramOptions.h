@@ -0,0 +1,49 @@
+#ifndef PROGRAMOPTIONS_H
+#define PROGRAMOPTIONS_H
+
+#include <string>
+#include "Log.h"
+
+// command line arguments of the decryptor: the positional arguments
+// (.bckey file, encrypted file or directory, password and optional output path)
+// can be mixed with options starting with "--"; if a manifest is given,
+// the encrypted files are taken from it and the positional encrypted path is left out,
+// the same goes for an index; building an index only needs the encrypted path (or a
+// manifest) and listing an index needs no positional arguments at all
+struct ProgramOptions
+{
+	std::string keyfilePath;
+	std::string encryptedFilePath;
+	std::string password;
+	std::string outputFilePath;
+	std::string manifestPath;
+	std::string indexPath;
+	std::string buildIndexPath;
+	std::string listIndexPath;
+	unsigned int threadCount = 0;
+	unsigned int rsaValidationLevel = 3;
+	std::string statsPath;
+	unsigned int statsInterval = 0;
+	// how the encrypted files are read and the decrypted files written:
+	// "mmap" (default), "uring" or "pread"
+	std::string ioMode = "mmap";
+	// bypass the page cache, implies "uring" unless "pread" is chosen
+	bool isDirectIO = false;
+	// back big buffers with 2 MB pages
+	bool useHugePages = false;
+	// the least severe messages shown
+	LogLevel logLevel = LogLevel::Info;
+	// how the progress is shown: "auto" (default, a bar on a terminal), "bar", "json" or "off"
+	std::string progressMode = "auto";
+
+	// an output path which streams the decrypted data of a single file to the standard output
+	static const char *const StandardOutputPath;
+
+	bool Parse(int argc, char *argv[]);
+	static void PrintUsage();
+
+private:
+	static unsigned int ParseCount(const std::string& value, const std::string& option);
+};
+
+#endif
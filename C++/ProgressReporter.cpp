@@ -0,0 +1,247 @@
+#include "ProgressReporter.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include "Log.h"
+
+struct ProgressReporter::ThreadSlot
+{
+	ThreadCounters *counters = nullptr;
+
+	~ThreadSlot()
+	{
+		if (this->counters != nullptr)
+		{
+			ProgressReporter::Get().ReleaseThreadCounters(this->counters);
+		}
+	}
+};
+
+ProgressReporter& ProgressReporter::Get()
+{
+	static ProgressReporter reporter;
+	return reporter;
+}
+
+// only the calling thread writes its counters, so a load and a store are
+// enough where an atomic addition would need a locked instruction
+void ProgressReporter::AddData(unsigned long long bytes, unsigned long long blocks)
+{
+	ThreadCounters& counters = this->GetThreadCounters();
+	counters.bytes.store(counters.bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+	counters.blocks.store(counters.blocks.load(std::memory_order_relaxed) + blocks, std::memory_order_relaxed);
+}
+
+void ProgressReporter::SetFileCount(size_t fileCount)
+{
+	this->m_fileCount = fileCount;
+}
+
+void ProgressReporter::StartFile(unsigned long long bytes)
+{
+	this->m_totalBytes += bytes;
+	++this->m_startedFiles;
+}
+
+void ProgressReporter::FinishFile()
+{
+	++this->m_finishedFiles;
+}
+
+void ProgressReporter::Start(ProgressMode mode)
+{
+	this->m_mode = mode;
+	this->m_startTime = std::chrono::steady_clock::now();
+	if (mode == ProgressMode::Off)
+	{
+		return;
+	}
+
+	unsigned int interval = mode == ProgressMode::Bar ? ProgressReporter::BarInterval : ProgressReporter::JSONInterval;
+	this->m_reportThread = std::thread([this, interval]
+	{
+		std::unique_lock<std::mutex> lock(this->m_reportMutex);
+		while (!this->m_reportStop.wait_for(lock, std::chrono::milliseconds(interval), [this] { return this->m_isReportStopped; }))
+		{
+			this->Report(false);
+		}
+	});
+}
+
+void ProgressReporter::Finish()
+{
+	if (this->m_reportThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->m_reportMutex);
+			this->m_isReportStopped = true;
+		}
+		this->m_reportStop.notify_all();
+		this->m_reportThread.join();
+	}
+
+	// the final progress is only shown once
+	if (this->m_mode != ProgressMode::Off)
+	{
+		this->Report(true);
+		this->m_mode = ProgressMode::Off;
+	}
+}
+
+/*private*/ ProgressReporter::ThreadCounters& ProgressReporter::GetThreadCounters()
+{
+	static thread_local ThreadSlot slot;
+	if (slot.counters == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(this->m_countersMutex);
+		if (!this->m_freeCounters.empty())
+		{
+			slot.counters = this->m_freeCounters.back();
+			this->m_freeCounters.pop_back();
+		}
+		else
+		{
+			this->m_threadCounters.emplace_back();
+			slot.counters = &this->m_threadCounters.back();
+		}
+	}
+	return *slot.counters;
+}
+
+/*private*/ void ProgressReporter::ReleaseThreadCounters(ThreadCounters *counters)
+{
+	std::lock_guard<std::mutex> lock(this->m_countersMutex);
+	this->m_freeCounters.push_back(counters);
+}
+
+// the counters are read while the threads go on adding to them,
+// so the sum is a snapshot that may be a chunk behind
+/*private*/ ProgressReporter::Sample ProgressReporter::TakeSample()
+{
+	Sample sample;
+	sample.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->m_startTime).count();
+
+	std::lock_guard<std::mutex> lock(this->m_countersMutex);
+	for (const ThreadCounters& counters : this->m_threadCounters)
+	{
+		sample.bytes += counters.bytes.load(std::memory_order_relaxed);
+		sample.blocks += counters.blocks.load(std::memory_order_relaxed);
+	}
+	return sample;
+}
+
+// the throughput is smoothed over the last samples, so the estimated time left doesn't jump
+// around with every chunk; the final report shows the average throughput of the whole run
+/*private*/ void ProgressReporter::Report(bool isFinal)
+{
+	Sample sample = this->TakeSample();
+	double interval = sample.seconds - this->m_lastSample.seconds;
+	if (interval > 0)
+	{
+		double bytesPerSecond = (sample.bytes - this->m_lastSample.bytes) / interval;
+		this->m_bytesPerSecond = this->m_lastSample.seconds > 0 ? 0.7 * this->m_bytesPerSecond + 0.3 * bytesPerSecond : bytesPerSecond;
+	}
+	this->m_lastSample = sample;
+
+	unsigned long long fileCount = this->m_fileCount;
+	unsigned long long startedFiles = this->m_startedFiles;
+	unsigned long long totalBytes = this->m_totalBytes;
+	if (startedFiles > 0 && fileCount > startedFiles)
+	{
+		totalBytes += (fileCount - startedFiles) * (totalBytes / startedFiles);
+	}
+	totalBytes = std::max(totalBytes, sample.bytes);
+
+	double etaSeconds = -1;
+	if (isFinal)
+	{
+		this->m_bytesPerSecond = sample.seconds > 0 ? sample.bytes / sample.seconds : 0;
+		etaSeconds = 0;
+	}
+	else if (this->m_bytesPerSecond > 0)
+	{
+		etaSeconds = (totalBytes - sample.bytes) / this->m_bytesPerSecond;
+	}
+
+	if (this->m_mode == ProgressMode::Bar)
+	{
+		Log::Get().WriteStatus(this->RenderBar(sample, isFinal ? sample.bytes : totalBytes, etaSeconds));
+		if (isFinal)
+		{
+			Log::Get().EndStatus();
+		}
+	}
+	else
+	{
+		Log::Get().WriteOutput(this->RenderJSON(sample, totalBytes, etaSeconds) + "\n");
+	}
+}
+
+/*private*/ std::string ProgressReporter::RenderBar(const Sample& sample, unsigned long long totalBytes, double etaSeconds) const
+{
+	const size_t barWidth = 30;
+	double fraction = totalBytes > 0 ? static_cast<double>(sample.bytes) / totalBytes : 0;
+	size_t filled = std::min(static_cast<size_t>(fraction * barWidth), barWidth);
+
+	std::ostringstream bar;
+	bar << "[" << std::string(filled, '#') << std::string(barWidth - filled, ' ') << "] "
+		<< std::setw(3) << static_cast<int>(fraction * 100) << "%  "
+		<< this->m_finishedFiles << "/" << this->m_fileCount << " files  "
+		<< ProgressReporter::FormatBytes(static_cast<double>(sample.bytes)) << " / " << ProgressReporter::FormatBytes(static_cast<double>(totalBytes)) << "  "
+		<< ProgressReporter::FormatBytes(this->m_bytesPerSecond) << "/s  "
+		<< (etaSeconds == 0 ? "done in " + ProgressReporter::FormatDuration(sample.seconds) : "ETA " + ProgressReporter::FormatDuration(etaSeconds));
+	return bar.str();
+}
+
+/*private*/ std::string ProgressReporter::RenderJSON(const Sample& sample, unsigned long long totalBytes, double etaSeconds) const
+{
+	std::ostringstream json;
+	json << std::fixed << std::setprecision(3)
+		<< "{\"wallSeconds\":" << sample.seconds
+		<< ",\"bytes\":" << sample.bytes
+		<< ",\"totalBytes\":" << totalBytes
+		<< ",\"blocks\":" << sample.blocks
+		<< ",\"finishedFiles\":" << this->m_finishedFiles
+		<< ",\"files\":" << this->m_fileCount
+		<< ",\"throughputMBps\":" << this->m_bytesPerSecond / (1024 * 1024)
+		<< ",\"etaSeconds\":";
+	if (etaSeconds >= 0)
+	{
+		json << etaSeconds;
+	}
+	else
+	{
+		json << "null";
+	}
+	json << "}";
+	return json.str();
+}
+
+/*private*/ std::string ProgressReporter::FormatBytes(double bytes)
+{
+	const char *units[] = { "B", "KB", "MB", "GB", "TB" };
+	size_t unit = 0;
+	while (bytes >= 1024 && unit < 4)
+	{
+		bytes /= 1024;
+		++unit;
+	}
+
+	std::ostringstream text;
+	text << std::fixed << std::setprecision(unit > 0 ? 1 : 0) << bytes << " " << units[unit];
+	return text.str();
+}
+
+// unknown times (no throughput yet) are shown as dashes
+/*private*/ std::string ProgressReporter::FormatDuration(double seconds)
+{
+	if (seconds < 0)
+	{
+		return "-:--:--";
+	}
+
+	unsigned long long totalSeconds = static_cast<unsigned long long>(seconds + 0.5);
+	std::ostringstream text;
+	text << totalSeconds / 3600 << ":" << std::setfill('0') << std::setw(2) << totalSeconds / 60 % 60 << ":" << std::setw(2) << totalSeconds % 60;
+	return text.str();
+}
@@ -0,0 +1,105 @@
+#ifndef PROGRESSREPORTER_H
+#define PROGRESSREPORTER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// how the progress of a run is shown
+enum class ProgressMode
+{
+	Off,
+	// a bar at the bottom of the terminal, which is redrawn in place
+	Bar,
+	// one JSON object per line on the standard output
+	JSON
+};
+
+// shows the progress of all files which are decrypted at the same time: the threads which
+// decrypt the data only add to counters of their own (no locks and no shared cache lines),
+// a reporter thread adds them up every [interval] and shows the decrypted bytes of all files,
+// the throughput and the estimated time left; files whose size isn't known yet (their header
+// wasn't parsed) are estimated with the average size of the files that started
+class ProgressReporter
+{
+public:
+	ProgressReporter(const ProgressReporter&) = delete;
+	ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+	static ProgressReporter& Get();
+
+	// called by the decrypting threads for every chunk or range of blocks they are done with
+	void AddData(unsigned long long bytes, unsigned long long blocks);
+
+	// the number of files of the run, [bytes] of a file join the total when its decryption
+	// starts, every file of the run is finished once, whether it was decrypted or not
+	void SetFileCount(size_t fileCount);
+	void StartFile(unsigned long long bytes);
+	void FinishFile();
+
+	void Start(ProgressMode mode);
+	// shows the final progress
+	void Finish();
+
+	static const unsigned int BarInterval = 250;
+	static const unsigned int JSONInterval = 1000;
+
+private:
+	// a cache line of its own for each thread, only written by that thread
+	struct alignas(64) ThreadCounters
+	{
+		std::atomic<unsigned long long> bytes{ 0 };
+		std::atomic<unsigned long long> blocks{ 0 };
+	};
+
+	struct Sample
+	{
+		double seconds = 0;
+		unsigned long long bytes = 0;
+		unsigned long long blocks = 0;
+	};
+
+	// gives the counters of a thread back when the thread ends
+	struct ThreadSlot;
+
+	// a deque keeps the counters where they are when more threads come along, the counters
+	// of threads which ended are taken over by new ones (e.g. of the next thread pool) and
+	// go on counting from where they are
+	std::mutex m_countersMutex;
+	std::deque<ThreadCounters> m_threadCounters;
+	std::vector<ThreadCounters *> m_freeCounters;
+
+	std::atomic<unsigned long long> m_fileCount{ 0 };
+	std::atomic<unsigned long long> m_startedFiles{ 0 };
+	std::atomic<unsigned long long> m_finishedFiles{ 0 };
+	std::atomic<unsigned long long> m_totalBytes{ 0 };
+
+	ProgressMode m_mode = ProgressMode::Off;
+	std::chrono::steady_clock::time_point m_startTime;
+	Sample m_lastSample;
+	double m_bytesPerSecond = 0;
+
+	std::thread m_reportThread;
+	std::mutex m_reportMutex;
+	std::condition_variable m_reportStop;
+	bool m_isReportStopped = false;
+
+	ProgressReporter() = default;
+
+	ThreadCounters& GetThreadCounters();
+	void ReleaseThreadCounters(ThreadCounters *counters);
+	Sample TakeSample();
+	void Report(bool isFinal);
+	std::string RenderBar(const Sample& sample, unsigned long long totalBytes, double etaSeconds) const;
+	std::string RenderJSON(const Sample& sample, unsigned long long totalBytes, double etaSeconds) const;
+	static std::string FormatBytes(double bytes);
+	static std::string FormatDuration(double seconds);
+};
+
+#endif
@@ -1,60 +1,59 @@
 #include "RSAHelper.h"
-#include <iostream>
 #include <stdexcept>
 #include "Base64Helper.h"
-#include "rsa.h"
+#include "Log.h"
 #include "osrng.h"
 
 bool RSAHelper::DecryptData(const std::string& encryptedFileKey, const std::string& decryptedPrivateKey, std::vector<byte>& decryptedFileKey)
 {
-	std::cout << "RSA decryption of data started" << std::endl;
+	// create / load a RSA private key from the DER encoded key
+	// and make sure it is valid
+	RSAPrivateKey privateKey(decryptedPrivateKey);
+	return RSAHelper::DecryptData(encryptedFileKey, privateKey, decryptedFileKey);
+}
 
-	if (decryptedPrivateKey.size() > 0)
+bool RSAHelper::DecryptData(const std::string& encryptedFileKey, const RSAPrivateKey& privateKey, std::vector<byte>& decryptedFileKey, bool silent /* = false*/)
+{
+	if (!silent)
+	{
+		LOG_DEBUG("RSA decryption of data started");
+	}
+
+	// encrypted file key is base 64 encoded, it is decoded into a buffer every thread
+	// keeps for all file keys, as there is one for each file of a batch run
+	if (encryptedFileKey.empty())
 	{
-		// encrypted file key is base 64 encoded
-		std::vector<byte> decodedFileKey;
-		Base64Helper::Decode(encryptedFileKey, decodedFileKey);
-
-		// private key is stored in a simplified PEM format (no header/footer and no line breaks)
-		// decode it from base 64 again to get the DER encoding needed by Crypto++
-		std::vector<byte> privateKeyDEREncoded;
-		Base64Helper::Decode(decryptedPrivateKey, privateKeyDEREncoded);
-
-		// dump the DER encoded private key into a (source) format Crypto++ can use
-		const byte *pk = privateKeyDEREncoded.data();
-		CryptoPP::ArraySource pkSource(pk, privateKeyDEREncoded.size(), true);
-
-		// create / load a RSA private key from the DER encoded key 
-		// and make sure it is valid
-		CryptoPP::RSA::PrivateKey privateRSAKey;
-		privateRSAKey.BERDecodePrivateKey(pkSource, false, 0);
-		CryptoPP::AutoSeededRandomPool rng;
-		if (!privateRSAKey.Validate(rng, 3))
-		{
-			throw std::runtime_error("Private RSA key could not be validated");
-		}
-
-		// initialize the RSA decryptor with the created private key 
-		CryptoPP::RSAES_OAEP_SHA_Decryptor rsaDecryptor(privateRSAKey);
-
-		// make sure the output vector is big enough to hold all of the plain text
-		decryptedFileKey.clear();
-		decryptedFileKey.resize(rsaDecryptor.MaxPlaintextLength(decodedFileKey.size()));
-
-		// decrypt the input und save it in the output vector
-		const byte *encryptedKey = decodedFileKey.data();
-		byte *decryptedKey = decryptedFileKey.data();
-		auto result = rsaDecryptor.Decrypt(rng, encryptedKey, decodedFileKey.size(), decryptedKey);
-
-		// and finally, resize the output vector from the
-		// max decrypted length to the actual decrypted length
-		decryptedFileKey.resize(result.messageLength);
-
-		std::cout << "RSA decryption finished" << std::endl;
-		return true;
+		throw std::runtime_error("No data to decode");
 	}
-	else
+	thread_local std::vector<byte> decodedFileKey;
+	decodedFileKey.resize(Base64Helper::GetMaxDecodedSize(encryptedFileKey.size()));
+	size_t decodedFileKeyLen = Base64Helper::Decode(encryptedFileKey.data(), encryptedFileKey.size(), decodedFileKey.data());
+
+	// the decryptor was initialized with the private key when it was loaded
+	const CryptoPP::RSAES_OAEP_SHA_Decryptor& rsaDecryptor = privateKey.GetDecryptor();
+
+	// make sure the output vector is big enough to hold all of the plain text
+	decryptedFileKey.clear();
+	decryptedFileKey.resize(rsaDecryptor.MaxPlaintextLength(decodedFileKeyLen));
+
+	// decrypt the input und save it in the output vector; seeding a random pool is
+	// expensive compared to the decryption, so every thread keeps its own one
+	thread_local CryptoPP::AutoSeededRandomPool rng;
+	const byte *encryptedKey = decodedFileKey.data();
+	byte *decryptedKey = decryptedFileKey.data();
+	auto result = rsaDecryptor.Decrypt(rng, encryptedKey, decodedFileKeyLen, decryptedKey);
+	if (!result.isValidCoding)
+	{
+		throw std::runtime_error("File key could not be decrypted, make sure the file was encrypted for the given account");
+	}
+
+	// and finally, resize the output vector from the
+	// max decrypted length to the actual decrypted length
+	decryptedFileKey.resize(result.messageLength);
+
+	if (!silent)
 	{
-		throw std::runtime_error("The private key used for the RSA decryption can't be of length 0");
+		LOG_DEBUG("RSA decryption finished");
 	}
-}
\ No newline at end of file
+	return true;
+}
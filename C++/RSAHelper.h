@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include "TypeDefs.h"
+#include "RSAPrivateKey.h"
 
 class RSAHelper
 {
@@ -11,6 +12,7 @@ public:
 	RSAHelper() = delete;
 
 	static bool DecryptData(const std::string& encryptedFileKey, const std::string& decryptedPrivateKey, std::vector<byte>& decryptedFileKey);
+	static bool DecryptData(const std::string& encryptedFileKey, const RSAPrivateKey& privateKey, std::vector<byte>& decryptedFileKey, bool silent = false);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include "RSAPrivateKey.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include "Base64Helper.h"
+#include "osrng.h"
+#include "sha.h"
+
+RSAPrivateKey::RSAPrivateKey(const std::string& decryptedPrivateKey, unsigned int validationLevel /* = DefaultValidationLevel*/, bool skipKnownKeys /* = true*/)
+{
+	if (decryptedPrivateKey.size() == 0)
+	{
+		throw std::runtime_error("The private key used for the RSA decryption can't be of length 0");
+	}
+	if (validationLevel > 3)
+	{
+		throw std::runtime_error("The validation level of the private RSA key must be between 0 and 3");
+	}
+
+	// private key is stored in a simplified PEM format (no header/footer and no line breaks)
+	// decode it from base 64 again to get the DER encoding needed by Crypto++
+	std::vector<byte> privateKeyDEREncoded;
+	Base64Helper::Decode(decryptedPrivateKey, privateKeyDEREncoded);
+
+	// dump the DER encoded private key into a (source) format Crypto++ can use
+	// and load the RSA private key from it
+	const byte *pk = privateKeyDEREncoded.data();
+	CryptoPP::ArraySource pkSource(pk, privateKeyDEREncoded.size(), true);
+	CryptoPP::RSA::PrivateKey& privateRSAKey = this->m_rsaDecryptor.AccessKey();
+	privateRSAKey.BERDecodePrivateKey(pkSource, false, 0);
+
+	// keys are remembered by the hash of their encoding together with
+	// the highest validation level they passed
+	static std::mutex validatedKeysMutex;
+	static std::map<std::string, unsigned int> validatedKeys;
+	std::string keyDigest(CryptoPP::SHA256::DIGESTSIZE, '\0');
+	CryptoPP::SHA256().CalculateDigest(reinterpret_cast<byte *>(&keyDigest[0]), privateKeyDEREncoded.data(), privateKeyDEREncoded.size());
+
+	if (skipKnownKeys)
+	{
+		std::lock_guard<std::mutex> lock(validatedKeysMutex);
+		auto validatedKey = validatedKeys.find(keyDigest);
+		if (validatedKey != validatedKeys.end() && validatedKey->second >= validationLevel)
+		{
+			return;
+		}
+	}
+
+	// make sure the key is valid
+	CryptoPP::AutoSeededRandomPool rng;
+	if (!privateRSAKey.Validate(rng, validationLevel))
+	{
+		throw std::runtime_error("Private RSA key could not be validated");
+	}
+
+	std::lock_guard<std::mutex> lock(validatedKeysMutex);
+	unsigned int& validatedLevel = validatedKeys[keyDigest];
+	validatedLevel = std::max(validatedLevel, validationLevel);
+}
+
+const CryptoPP::RSAES_OAEP_SHA_Decryptor& RSAPrivateKey::GetDecryptor() const
+{
+	return this->m_rsaDecryptor;
+}
@@ -0,0 +1,31 @@
+#ifndef RSAPRIVATEKEY_H
+#define RSAPRIVATEKEY_H
+
+#include <string>
+#include "TypeDefs.h"
+#include "rsa.h"
+
+// the private RSA key of the user, decoded and validated once when the object is created,
+// so unwrapping the file keys afterwards only costs the OAEP decryption itself; the object
+// is not changed by decryptions and can be used by several threads at once
+class RSAPrivateKey
+{
+public:
+	// level of the key validation in Crypto++ (0 - 3), level 3 does
+	// probabilistic primality tests of the primes of the key
+	static const unsigned int DefaultValidationLevel = 3;
+
+	// if [skipKnownKeys] is set, a key which already passed the validation with at least the
+	// same level in this process (e.g. for a previous file of a batch) is not validated again
+	explicit RSAPrivateKey(const std::string& decryptedPrivateKey, unsigned int validationLevel = DefaultValidationLevel, bool skipKnownKeys = true);
+
+	RSAPrivateKey(const RSAPrivateKey&) = delete;
+	RSAPrivateKey& operator=(const RSAPrivateKey&) = delete;
+
+	const CryptoPP::RSAES_OAEP_SHA_Decryptor& GetDecryptor() const;
+
+private:
+	CryptoPP::RSAES_OAEP_SHA_Decryptor m_rsaDecryptor;
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include "RunStatistics.h"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include "BufferPool.h"
+#include "Log.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+// converts a FILETIME (100 ns units) of the Windows API
+#ifdef _WIN32
+static std::chrono::nanoseconds ToNanoseconds(const FILETIME& time)
+{
+	unsigned long long ticks = (static_cast<unsigned long long>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+	return std::chrono::nanoseconds(ticks * 100);
+}
+#endif
+
+// CPU time (user and system) of the whole process and its peak memory usage
+static void GetProcessUsage(std::chrono::nanoseconds& cpuTime, unsigned long long& peakRSSBytes)
+{
+#ifdef _WIN32
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime);
+	cpuTime = ToNanoseconds(kernelTime) + ToNanoseconds(userTime);
+
+	PROCESS_MEMORY_COUNTERS memoryCounters;
+	peakRSSBytes = GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters)) ? memoryCounters.PeakWorkingSetSize : 0;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	cpuTime = std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+		+ std::chrono::microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+
+	// the maximum resident set size is given in kilobytes
+	peakRSSBytes = static_cast<unsigned long long>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+RunStatistics::RunStatistics()
+	: m_startTime(std::chrono::steady_clock::now())
+{
+}
+
+RunStatistics& RunStatistics::Get()
+{
+	static RunStatistics statistics;
+	return statistics;
+}
+
+void RunStatistics::AddStageTime(Stage stage, std::chrono::nanoseconds wallTime, std::chrono::nanoseconds cpuTime)
+{
+	StageCounters& counters = this->m_stages[static_cast<size_t>(stage)];
+	counters.wallNs += wallTime.count();
+	counters.cpuNs += cpuTime.count();
+	++counters.calls;
+}
+
+void RunStatistics::AddData(unsigned long long bytesIn, unsigned long long bytesOut, unsigned long long blocks)
+{
+	this->m_bytesIn += bytesIn;
+	this->m_bytesOut += bytesOut;
+	this->m_blocks += blocks;
+}
+
+void RunStatistics::AddFile(bool isDecrypted)
+{
+	++(isDecrypted ? this->m_decryptedFiles : this->m_failedFiles);
+}
+
+void RunStatistics::SetThreadCount(unsigned int threadCount)
+{
+	this->m_threadCount = threadCount;
+}
+
+std::string RunStatistics::ToJSON() const
+{
+	double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - this->m_startTime).count();
+	std::chrono::nanoseconds cpuTime;
+	unsigned long long peakRSSBytes = 0;
+	GetProcessUsage(cpuTime, peakRSSBytes);
+	double cpuSeconds = std::chrono::duration<double>(cpuTime).count();
+
+	// the utilization relates the used CPU time to the time all threads could have used
+	double threadUtilization = wallSeconds > 0 ? cpuSeconds / (wallSeconds * this->m_threadCount) : 0;
+	double throughputMBps = wallSeconds > 0 ? this->m_bytesOut / wallSeconds / (1024 * 1024) : 0;
+
+	std::ostringstream json;
+	json << std::fixed << std::setprecision(6)
+		<< "{\"wallSeconds\":" << wallSeconds
+		<< ",\"cpuSeconds\":" << cpuSeconds
+		<< ",\"threads\":" << this->m_threadCount
+		<< ",\"threadUtilization\":" << threadUtilization
+		<< ",\"peakRSSBytes\":" << peakRSSBytes
+		<< ",\"decryptedFiles\":" << this->m_decryptedFiles
+		<< ",\"failedFiles\":" << this->m_failedFiles
+		<< ",\"bytesIn\":" << this->m_bytesIn
+		<< ",\"bytesOut\":" << this->m_bytesOut
+		<< ",\"blocks\":" << this->m_blocks
+		<< ",\"throughputMBps\":" << throughputMBps;
+
+	BufferPoolStatistics bufferPool = BufferPool::Get().GetStatistics();
+	json << ",\"bufferPool\":{\"acquisitions\":" << bufferPool.acquisitions
+		<< ",\"reuses\":" << bufferPool.reuses
+		<< ",\"allocations\":" << bufferPool.allocations
+		<< ",\"reservedBytes\":" << bufferPool.reservedBytes
+		<< ",\"hugePageBytes\":" << bufferPool.hugePageBytes
+		<< ",\"freedBytes\":" << bufferPool.freedBytes
+		<< ",\"usedBytes\":" << bufferPool.usedBytes
+		<< ",\"peakUsedBytes\":" << bufferPool.peakUsedBytes << "}"
+		<< ",\"stages\":{";
+	for (size_t i = 0; i < static_cast<size_t>(Stage::Count); ++i)
+	{
+		const StageCounters& counters = this->m_stages[i];
+		json << (i > 0 ? "," : "") << "\"" << RunStatistics::GetStageName(static_cast<Stage>(i)) << "\":{"
+			<< "\"wallSeconds\":" << counters.wallNs / 1e9
+			<< ",\"cpuSeconds\":" << counters.cpuNs / 1e9
+			<< ",\"calls\":" << counters.calls << "}";
+	}
+	json << "}}";
+	return json.str();
+}
+
+void RunStatistics::StartReport(const std::string& path, unsigned int intervalSeconds)
+{
+	this->m_reportPath = path;
+	if (intervalSeconds == 0)
+	{
+		return;
+	}
+
+	this->m_reportThread = std::thread([this, intervalSeconds]
+	{
+		std::unique_lock<std::mutex> lock(this->m_reportMutex);
+		while (!this->m_reportStop.wait_for(lock, std::chrono::seconds(intervalSeconds), [this] { return this->m_isReportStopped; }))
+		{
+			this->WriteReport();
+		}
+	});
+}
+
+void RunStatistics::FinishReport()
+{
+	if (this->m_reportThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->m_reportMutex);
+			this->m_isReportStopped = true;
+		}
+		this->m_reportStop.notify_all();
+		this->m_reportThread.join();
+	}
+
+	if (this->m_reportPath.length() > 0)
+	{
+		this->WriteReport();
+	}
+}
+
+std::chrono::nanoseconds RunStatistics::GetThreadCPUTime()
+{
+#ifdef _WIN32
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime);
+	return ToNanoseconds(kernelTime) + ToNanoseconds(userTime);
+#else
+	struct timespec time;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+	return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+#endif
+}
+
+// periodic reports on the standard output are written as one line each,
+// a file always holds the latest report only
+/*private*/ void RunStatistics::WriteReport()
+{
+	std::string json = this->ToJSON();
+	if (this->m_reportPath == "-")
+	{
+		Log::Get().WriteOutput(json + "\n");
+		return;
+	}
+
+	std::ofstream report(this->m_reportPath, std::ios::trunc);
+	report << json << std::endl;
+	if (!report.good())
+	{
+		LOG_ERROR("Statistics could not be written to '" << this->m_reportPath << "'");
+	}
+}
+
+/*private*/ const char *RunStatistics::GetStageName(Stage stage)
+{
+	switch (stage)
+	{
+	case Stage::KeyfileParse: return "keyfileParse";
+	case Stage::PBKDF2: return "pbkdf2";
+	case Stage::RSAKeyLoad: return "rsaKeyLoad";
+	case Stage::RSAUnwrap: return "rsaUnwrap";
+	case Stage::HeaderParse: return "headerParse";
+	case Stage::IVDerivation: return "ivDerivation";
+	case Stage::AES: return "aes";
+	case Stage::Read: return "read";
+	case Stage::Write: return "write";
+	default: return "unknown";
+	}
+}
+
+StageTimer::StageTimer(Stage stage)
+	: m_stage(stage), m_wallStart(std::chrono::steady_clock::now()), m_cpuStart(RunStatistics::GetThreadCPUTime())
+{
+}
+
+StageTimer::~StageTimer()
+{
+	RunStatistics::Get().AddStageTime(this->m_stage, std::chrono::steady_clock::now() - this->m_wallStart, RunStatistics::GetThreadCPUTime() - this->m_cpuStart);
+}
@@ -0,0 +1,97 @@
+#ifndef RUNSTATISTICS_H
+#define RUNSTATISTICS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// the stages of a run, their times are collected separately
+enum class Stage
+{
+	KeyfileParse,
+	PBKDF2,
+	RSAKeyLoad,
+	RSAUnwrap,
+	HeaderParse,
+	IVDerivation,
+	AES,
+	Read,
+	Write,
+	Count
+};
+
+// collects the times, data amounts and resource usage of the whole run and writes them
+// as JSON; all counters are atomic, so every thread can report into the same object
+class RunStatistics
+{
+public:
+	RunStatistics(const RunStatistics&) = delete;
+	RunStatistics& operator=(const RunStatistics&) = delete;
+
+	static RunStatistics& Get();
+
+	void AddStageTime(Stage stage, std::chrono::nanoseconds wallTime, std::chrono::nanoseconds cpuTime);
+	void AddData(unsigned long long bytesIn, unsigned long long bytesOut, unsigned long long blocks);
+	void AddFile(bool isDecrypted);
+	void SetThreadCount(unsigned int threadCount);
+
+	std::string ToJSON() const;
+
+	// writes the statistics to [path] ("-" for the standard output) every [intervalSeconds]
+	// seconds (0 to disable) and once more when FinishReport is called
+	void StartReport(const std::string& path, unsigned int intervalSeconds);
+	void FinishReport();
+
+	// CPU time the calling thread used so far
+	static std::chrono::nanoseconds GetThreadCPUTime();
+
+private:
+	struct StageCounters
+	{
+		std::atomic<unsigned long long> wallNs{ 0 };
+		std::atomic<unsigned long long> cpuNs{ 0 };
+		std::atomic<unsigned long long> calls{ 0 };
+	};
+
+	std::chrono::steady_clock::time_point m_startTime;
+	StageCounters m_stages[static_cast<size_t>(Stage::Count)];
+	std::atomic<unsigned long long> m_bytesIn{ 0 };
+	std::atomic<unsigned long long> m_bytesOut{ 0 };
+	std::atomic<unsigned long long> m_blocks{ 0 };
+	std::atomic<unsigned long long> m_decryptedFiles{ 0 };
+	std::atomic<unsigned long long> m_failedFiles{ 0 };
+	std::atomic<unsigned int> m_threadCount{ 1 };
+
+	std::string m_reportPath;
+	std::thread m_reportThread;
+	std::mutex m_reportMutex;
+	std::condition_variable m_reportStop;
+	bool m_isReportStopped = false;
+
+	RunStatistics();
+
+	void WriteReport();
+	static const char *GetStageName(Stage stage);
+};
+
+// measures the wall and CPU time of a stage from its creation until it goes out of scope
+class StageTimer
+{
+public:
+	explicit StageTimer(Stage stage);
+	~StageTimer();
+
+	StageTimer(const StageTimer&) = delete;
+	StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+	Stage m_stage;
+	std::chrono::steady_clock::time_point m_wallStart;
+	std::chrono::nanoseconds m_cpuStart;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "ThreadPool.h"
+#include <stdexcept>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	if (threadCount == 0)
+	{
+		throw std::runtime_error("Thread count must be bigger than zero");
+	}
+
+	// the thread calling ParallelFor is used as worker too
+	for (unsigned int i = 1; i < threadCount; ++i)
+	{
+		this->m_workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+		this->m_stop = true;
+	}
+	this->m_workAvailable.notify_all();
+
+	for (auto& worker : this->m_workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::ParallelFor(size_t taskCount, const std::function<void(size_t)>& task)
+{
+	if (taskCount == 0)
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(this->m_mutex);
+	this->m_task = &task;
+	this->m_taskCount = taskCount;
+	this->m_nextTask = 0;
+	this->m_finishedTasks = 0;
+	this->m_error = nullptr;
+	++this->m_generation;
+	this->m_workAvailable.notify_all();
+
+	this->RunTasks(lock);
+
+	// wait for the tasks still running on other threads and until every worker
+	// left this generation, so none of them touches the task after we return
+	this->m_workDone.wait(lock, [this] { return this->m_finishedTasks == this->m_taskCount && this->m_activeWorkers == 0; });
+	this->m_task = nullptr;
+
+	if (this->m_error)
+	{
+		std::exception_ptr error = this->m_error;
+		this->m_error = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+unsigned int ThreadPool::GetThreadCount() const
+{
+	return static_cast<unsigned int>(this->m_workers.size()) + 1;
+}
+
+unsigned int ThreadPool::GetDefaultThreadCount()
+{
+	// hardware_concurrency may return 0 if the value is not computable
+	unsigned int threadCount = std::thread::hardware_concurrency();
+	return threadCount > 0 ? threadCount : 1;
+}
+
+/*private*/ void ThreadPool::WorkerLoop()
+{
+	unsigned long seenGeneration = 0;
+	std::unique_lock<std::mutex> lock(this->m_mutex);
+	while (true)
+	{
+		this->m_workAvailable.wait(lock, [&] { return this->m_stop || this->m_generation != seenGeneration; });
+		if (this->m_stop)
+		{
+			return;
+		}
+
+		seenGeneration = this->m_generation;
+		++this->m_activeWorkers;
+		this->RunTasks(lock);
+		--this->m_activeWorkers;
+		this->m_workDone.notify_all();
+	}
+}
+
+// takes tasks of the current generation until there are none left,
+// the lock is only released while a task is running
+/*private*/ void ThreadPool::RunTasks(std::unique_lock<std::mutex>& lock)
+{
+	while (this->m_nextTask < this->m_taskCount)
+	{
+		size_t taskNo = this->m_nextTask++;
+		auto task = this->m_task;
+
+		lock.unlock();
+		std::exception_ptr error;
+		try
+		{
+			(*task)(taskNo);
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+		lock.lock();
+
+		++this->m_finishedTasks;
+		if (error)
+		{
+			// skip the tasks nobody started yet
+			if (!this->m_error)
+			{
+				this->m_error = error;
+			}
+			this->m_finishedTasks += this->m_taskCount - this->m_nextTask;
+			this->m_nextTask = this->m_taskCount;
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned int threadCount);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// runs task(0) ... task(taskCount - 1) on the pool and waits until all of them are done,
+	// the calling thread works on the tasks as well and the first exception thrown by a task
+	// is rethrown here after the remaining tasks were skipped
+	void ParallelFor(size_t taskCount, const std::function<void(size_t)>& task);
+	unsigned int GetThreadCount() const;
+
+	static unsigned int GetDefaultThreadCount();
+
+private:
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_workAvailable;
+	std::condition_variable m_workDone;
+	const std::function<void(size_t)> *m_task = nullptr;
+	size_t m_taskCount = 0;
+	size_t m_nextTask = 0;
+	size_t m_finishedTasks = 0;
+	unsigned int m_activeWorkers = 0;
+	unsigned long m_generation = 0;
+	bool m_stop = false;
+	std::exception_ptr m_error;
+
+	void WorkerLoop();
+	void RunTasks(std::unique_lock<std::mutex>& lock);
+};
+
+#endif
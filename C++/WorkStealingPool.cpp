@@ -0,0 +1,152 @@
+#include "WorkStealingPool.h"
+#include <stdexcept>
+
+WorkStealingPool::WorkStealingPool(unsigned int threadCount)
+{
+	if (threadCount == 0)
+	{
+		throw std::runtime_error("Thread count must be bigger than zero");
+	}
+
+	for (unsigned int workerNo = 0; workerNo < threadCount; ++workerNo)
+	{
+		this->m_queues.emplace_back(new WorkerQueue());
+	}
+	for (unsigned int workerNo = 0; workerNo < threadCount; ++workerNo)
+	{
+		this->m_workers.emplace_back(&WorkStealingPool::WorkerLoop, this, workerNo);
+	}
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(this->m_mutex);
+		this->m_workDone.wait(lock, [this] { return this->m_unfinishedTasks == 0; });
+		this->m_stop = true;
+	}
+	this->m_workAvailable.notify_all();
+
+	for (auto& worker : this->m_workers)
+	{
+		worker.join();
+	}
+}
+
+void WorkStealingPool::Submit(std::vector<Task>& tasks)
+{
+	if (tasks.empty())
+	{
+		return;
+	}
+
+	WorkerQueue& queue = *this->m_queues[this->m_nextQueue];
+	this->m_nextQueue = (this->m_nextQueue + 1) % this->m_queues.size();
+	this->m_unfinishedTasks += tasks.size();
+	{
+		std::lock_guard<std::mutex> queueLock(queue.mutex);
+		for (auto& task : tasks)
+		{
+			queue.tasks.push_back(std::move(task));
+		}
+		this->m_queuedTasks += tasks.size();
+	}
+	tasks.clear();
+
+	// the lock orders the new tasks before the check of a worker that is about to sleep
+	{
+		std::lock_guard<std::mutex> lock(this->m_mutex);
+	}
+	this->m_workAvailable.notify_all();
+}
+
+void WorkStealingPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(this->m_mutex);
+	this->m_workDone.wait(lock, [this] { return this->m_unfinishedTasks == 0; });
+
+	if (this->m_error)
+	{
+		std::exception_ptr error = this->m_error;
+		this->m_error = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+unsigned int WorkStealingPool::GetThreadCount() const
+{
+	return static_cast<unsigned int>(this->m_workers.size());
+}
+
+unsigned long long WorkStealingPool::GetStolenCount() const
+{
+	return this->m_stolenTasks;
+}
+
+/*private*/ void WorkStealingPool::WorkerLoop(unsigned int workerNo)
+{
+	while (true)
+	{
+		Task task;
+		if (this->TakeTask(workerNo, task))
+		{
+			try
+			{
+				task(workerNo);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(this->m_mutex);
+				if (!this->m_error)
+				{
+					this->m_error = std::current_exception();
+				}
+			}
+
+			task = nullptr;
+			if (--this->m_unfinishedTasks == 0)
+			{
+				std::lock_guard<std::mutex> lock(this->m_mutex);
+				this->m_workDone.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(this->m_mutex);
+		this->m_workAvailable.wait(lock, [this] { return this->m_stop || this->m_queuedTasks > 0; });
+		if (this->m_stop)
+		{
+			return;
+		}
+	}
+}
+
+// takes the oldest task of the own queue or steals the newest one of another worker
+/*private*/ bool WorkStealingPool::TakeTask(unsigned int workerNo, Task& task)
+{
+	size_t queueCount = this->m_queues.size();
+	for (size_t i = 0; i < queueCount; ++i)
+	{
+		WorkerQueue& queue = *this->m_queues[(workerNo + i) % queueCount];
+		std::lock_guard<std::mutex> queueLock(queue.mutex);
+		if (queue.tasks.empty())
+		{
+			continue;
+		}
+
+		if (i == 0)
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		else
+		{
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+			++this->m_stolenTasks;
+		}
+		--this->m_queuedTasks;
+		return true;
+	}
+	return false;
+}
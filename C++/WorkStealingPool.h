@@ -0,0 +1,69 @@
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// runs tasks of very different sizes on a fixed set of threads: every worker has its own
+// queue, a group of tasks submitted together (e.g. the ranges of one file) goes to a single
+// worker, which takes them from the front; a worker without tasks steals from the back of the
+// queues of the others, so a big group is spread over all idle threads, while many small
+// groups don't contend for a single shared queue
+class WorkStealingPool
+{
+public:
+	// a task gets the number of the worker running it, so it can use state kept per worker
+	using Task = std::function<void(unsigned int workerNo)>;
+
+	explicit WorkStealingPool(unsigned int threadCount);
+	// waits until all tasks are done
+	~WorkStealingPool();
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	// queues the tasks on the next worker in turn, [tasks] is left empty;
+	// tasks are only submitted by one thread at a time
+	void Submit(std::vector<Task>& tasks);
+
+	// waits until all submitted tasks are done, the first exception
+	// thrown by a task is rethrown here
+	void Wait();
+
+	unsigned int GetThreadCount() const;
+	// number of tasks that were run by another worker than the one they were queued on
+	unsigned long long GetStolenCount() const;
+
+private:
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+	std::vector<std::thread> m_workers;
+	std::atomic<size_t> m_queuedTasks{ 0 };
+	std::atomic<size_t> m_unfinishedTasks{ 0 };
+	std::atomic<unsigned long long> m_stolenTasks{ 0 };
+	unsigned int m_nextQueue = 0;
+
+	std::mutex m_mutex;
+	std::condition_variable m_workAvailable;
+	std::condition_variable m_workDone;
+	bool m_stop = false;
+	std::exception_ptr m_error;
+
+	void WorkerLoop(unsigned int workerNo);
+	bool TakeTask(unsigned int workerNo, Task& task);
+};
+
+#endif
@@ -0,0 +1,383 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include "../TypeDefs.h"
+#include "../AESHelper.h"
+#include "../Base64Helper.h"
+#include "../BlockIVGenerator.h"
+#include "../EncryptedFileReader.h"
+#include "../FileBlockDecryptor.h"
+#include "../FileData.h"
+#include "../MappedFile.h"
+#include "../OutputFile.h"
+#include "../PBKDF2Helper.h"
+#include "../RSAHelper.h"
+#include "../RSAPrivateKey.h"
+#include "../ThreadPool.h"
+#include "hrtimer.h"
+#include "osrng.h"
+#include "rsa.h"
+
+// microbenchmarks for the single stages of the decryption, every benchmark runs its operation
+// repeatedly for at least [MinDuration] seconds and reports the time and the memory allocations
+// per operation; the first command line argument (optional) only runs the benchmarks whose name
+// contains it, e.g. "aes" or "rsa"
+
+// every allocation of the process is counted, so the allocations of an operation
+// are the difference of the counter before and after it
+static std::atomic<unsigned long long> allocationCount(0);
+
+void *operator new(size_t size)
+{
+	++allocationCount;
+	void *memory = std::malloc(size > 0 ? size : 1);
+	if (memory == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+	std::free(memory);
+}
+
+static const double MinDuration = 1.0;
+
+// the helpers report their progress on std::cout, which is silenced while benchmarking,
+// the results are written to a separate stream on the original buffer
+static std::ostream report(std::cout.rdbuf());
+static std::string nameFilter;
+
+static bool IsSelected(const std::string& name)
+{
+	return name.find(nameFilter) != std::string::npos;
+}
+
+// runs [operation] until [MinDuration] passed and reports the average per call,
+// [bytesPerOp] is the amount of data one call processes (0 if throughput makes no sense)
+static void RunBenchmark(const std::string& name, const std::string& parameters, size_t bytesPerOp, const std::function<void()>& operation)
+{
+	if (!IsSelected(name))
+	{
+		return;
+	}
+
+	// one warm up call, so lazily initialized state doesn't count
+	operation();
+
+	unsigned long long opCount = 0;
+	unsigned long long allocationsBefore = allocationCount;
+	CryptoPP::Timer timer(CryptoPP::TimerBase::NANOSECONDS);
+	timer.StartTimer();
+	double elapsedNs = 0;
+	do
+	{
+		operation();
+		++opCount;
+		elapsedNs = timer.ElapsedTimeAsDouble();
+	} while (elapsedNs < MinDuration * 1e9);
+	unsigned long long allocations = allocationCount - allocationsBefore;
+
+	double nsPerOp = elapsedNs / opCount;
+	report << std::left << std::setw(20) << name << std::setw(36) << parameters << std::right << std::fixed
+		<< std::setw(16) << std::setprecision(0) << nsPerOp << " ns/op";
+	if (bytesPerOp > 0)
+	{
+		report << std::setw(12) << std::setprecision(1) << bytesPerOp / (nsPerOp / 1e9) / (1024 * 1024) << " MB/s";
+	}
+	else
+	{
+		report << std::setw(17) << "";
+	}
+	report << std::setw(12) << std::setprecision(1) << static_cast<double>(allocations) / opCount << " allocs/op" << std::endl;
+}
+
+static std::vector<byte> RandomBytes(size_t count)
+{
+	CryptoPP::AutoSeededRandomPool rng;
+	std::vector<byte> bytes(count);
+	rng.GenerateBlock(bytes.data(), bytes.size());
+	return bytes;
+}
+
+static std::string ToBase64(const std::vector<byte>& data)
+{
+	std::string encoded;
+	Base64Helper::Encode(data, encoded);
+	return encoded;
+}
+
+static void BenchmarkBase64()
+{
+	for (size_t size : { 64, 4096, 1024 * 1024 })
+	{
+		std::string encoded = ToBase64(RandomBytes(size));
+		RunBenchmark("base64-decode", "bytes=" + std::to_string(size), encoded.size(), [&]
+		{
+			std::vector<byte> decoded;
+			Base64Helper::Decode(encoded, decoded);
+		});
+
+		std::vector<byte> buffer(Base64Helper::GetMaxDecodedSize(encoded.size()));
+		RunBenchmark("base64-decode-buffer", "bytes=" + std::to_string(size), encoded.size(), [&]
+		{
+			Base64Helper::Decode(encoded.data(), encoded.size(), buffer.data());
+		});
+	}
+}
+
+static void BenchmarkPBKDF2()
+{
+	std::vector<byte> salt = RandomBytes(32);
+	for (int iterations : { 1000, 10000, 100000 })
+	{
+		RunBenchmark("pbkdf2-sha512", "kdfIterations=" + std::to_string(iterations), 0, [&]
+		{
+			PBKDF2Helper pbkdf2("password", salt, iterations);
+			std::vector<byte> hashBytes;
+			pbkdf2.GetBytes(64, hashBytes);
+		});
+	}
+}
+
+static void BenchmarkHeaderParse(const std::filesystem::path& directory)
+{
+	if (!IsSelected("header-parse"))
+	{
+		return;
+	}
+
+	for (size_t fileKeyCount : { 1, 16 })
+	{
+		// a header like the ones of the corpus generator, without any file data
+		std::string coreHeader = R"({"cipher":{"algorithm":"AES","mode":"CBC","padding":"PKCS7","keySize":256,"blockSize":65536,"iv":")"
+			+ ToBase64(RandomBytes(16)) + R"("},"encryptedFileKeys":[)";
+		for (size_t keyNo = 0; keyNo < fileKeyCount; ++keyNo)
+		{
+			coreHeader += std::string(keyNo > 0 ? "," : "") + R"({"type":"user","id":"benchmark","value":")" + ToBase64(RandomBytes(512)) + R"("})";
+		}
+		coreHeader += "]}";
+
+		std::vector<byte> rawHeader(48, 0);
+		std::copy_n("bc01", 4, rawHeader.begin());
+		for (size_t i = 0; i < 4; ++i)
+		{
+			rawHeader[4 + i] = static_cast<byte>(coreHeader.size() >> (8 * i));
+		}
+
+		std::string inputPath = (directory / "header.bc").string();
+		{
+			std::ofstream inputFile(inputPath, std::ios::binary);
+			inputFile.write(reinterpret_cast<const char *>(rawHeader.data()), rawHeader.size());
+			inputFile << coreHeader;
+		}
+
+		{
+			MappedFile encryptedFile(inputPath);
+			RunBenchmark("header-parse", "fileKeys=" + std::to_string(fileKeyCount), rawHeader.size() + coreHeader.size(), [&]
+			{
+				FileData fileData;
+				fileData.ParseHeader(encryptedFile, true);
+			});
+		}
+		std::remove(inputPath.c_str());
+	}
+}
+
+static void BenchmarkRSA()
+{
+	// generating the keys takes a while, so it is skipped if it isn't needed
+	if (!IsSelected("rsa-load-key") && !IsSelected("rsa-unwrap"))
+	{
+		return;
+	}
+
+	CryptoPP::AutoSeededRandomPool rng;
+	for (unsigned int modulusBits : { 2048, 3072, 4096 })
+	{
+		// the private key is stored like in a .bckey file, the file key like in a file header
+		CryptoPP::RSA::PrivateKey rsaKey;
+		rsaKey.Initialize(rng, modulusBits, 65537);
+		std::string encodedKey;
+		CryptoPP::StringSink keySink(encodedKey);
+		rsaKey.DEREncodePrivateKey(keySink);
+		std::string decryptedPrivateKey = ToBase64(std::vector<byte>(encodedKey.begin(), encodedKey.end()));
+
+		std::vector<byte> fileKey = RandomBytes(64);
+		CryptoPP::RSAES_OAEP_SHA_Encryptor rsaEncryptor(rsaKey);
+		std::vector<byte> encryptedFileKey(rsaEncryptor.CiphertextLength(fileKey.size()));
+		rsaEncryptor.Encrypt(rng, fileKey.data(), fileKey.size(), encryptedFileKey.data());
+		std::string encodedFileKey = ToBase64(encryptedFileKey);
+
+		std::string parameters = "modulusBits=" + std::to_string(modulusBits);
+		for (unsigned int validationLevel : { 0, 3 })
+		{
+			RunBenchmark("rsa-load-key", parameters + " validation=" + std::to_string(validationLevel), 0, [&]
+			{
+				RSAPrivateKey privateKey(decryptedPrivateKey, validationLevel, false);
+			});
+		}
+
+		RSAPrivateKey privateKey(decryptedPrivateKey, 0);
+		RunBenchmark("rsa-unwrap", parameters, 0, [&]
+		{
+			std::vector<byte> decryptedFileKey;
+			RSAHelper::DecryptData(encodedFileKey, privateKey, decryptedFileKey, true);
+		});
+	}
+}
+
+static void BenchmarkBlockIVec()
+{
+	BlockIVGenerator blockIVGenerator(RandomBytes(16), RandomBytes(32));
+	byte blockIVec[BlockIVGenerator::MaxIVecSize];
+	unsigned long long blockNo = 0;
+	RunBenchmark("block-ivec", "ivecSize=16", 0, [&]
+	{
+		blockIVGenerator.ComputeBlockIVec(blockNo++, blockIVec);
+	});
+}
+
+static void BenchmarkAESBlocks()
+{
+	std::vector<byte> fileCryptoKey = RandomBytes(32);
+	BlockIVGenerator blockIVGenerator(RandomBytes(16), fileCryptoKey);
+	FileBlockDecryptor blockDecryptor(fileCryptoKey, blockIVGenerator);
+	for (size_t blockSize : { 512, 4096, 65536, 1024 * 1024 })
+	{
+		// one range of blocks as a single thread of AESHelper::DecryptFile gets it
+		size_t len = blockSize * AESHelper::DefaultBufferedBlocks;
+		std::vector<byte> input = RandomBytes(len);
+		std::vector<byte> output(len);
+		RunBenchmark("aes-decrypt-blocks", "blockSize=" + std::to_string(blockSize), len, [&]
+		{
+			blockDecryptor.DecryptBlocks(0, input.data(), output.data(), len, blockSize, false);
+		});
+	}
+}
+
+static void BenchmarkFileIO(const std::filesystem::path& directory)
+{
+	if (!IsSelected("file-read") && !IsSelected("file-write") && !IsSelected("file-decrypt") && !IsSelected("read-range"))
+	{
+		return;
+	}
+
+	std::vector<byte> fileCryptoKey = RandomBytes(32);
+	std::string baseIVec = ToBase64(RandomBytes(16));
+	for (size_t fileSize : { 1024 * 1024, 64 * 1024 * 1024 })
+	{
+		// random data without header and padding decrypts just like a real file body
+		std::string inputPath = (directory / ("input-" + std::to_string(fileSize) + ".bc")).string();
+		std::string outputPath = (directory / "output").string();
+		{
+			std::vector<byte> content = RandomBytes(fileSize);
+			std::ofstream(inputPath, std::ios::binary).write(reinterpret_cast<const char *>(content.data()), content.size());
+		}
+		std::string sizeParameter = "fileSize=" + std::to_string(fileSize);
+
+		RunBenchmark("file-read", sizeParameter, fileSize, [&]
+		{
+			// touch every page of the mapping once
+			MappedFile encryptedFile(inputPath);
+			encryptedFile.AdviseSequential(0, encryptedFile.GetSize());
+			volatile byte sum = 0;
+			for (size_t pos = 0; pos < encryptedFile.GetSize(); pos += 4096)
+			{
+				sum += encryptedFile.GetData()[pos];
+			}
+		});
+
+		RunBenchmark("file-write", sizeParameter, fileSize, [&]
+		{
+			OutputFile outputFile(outputPath, fileSize);
+			std::fill(outputFile.GetData(), outputFile.GetData() + fileSize, 0x5c);
+			outputFile.Close(fileSize);
+		});
+
+		for (unsigned int blockSize : { 4096, 65536, 1024 * 1024 })
+		{
+			for (unsigned int threadCount : { 1u, ThreadPool::GetDefaultThreadCount() })
+			{
+				std::string parameters = sizeParameter + " blockSize=" + std::to_string(blockSize) + " threads=" + std::to_string(threadCount);
+				RunBenchmark("file-decrypt", parameters, fileSize, [&]
+				{
+					MappedFile encryptedFile(inputPath);
+					OutputFile outputFile(outputPath, fileSize);
+					AESHelper::DecryptFile(encryptedFile, fileCryptoKey, baseIVec, blockSize, 0, 0, outputFile, threadCount);
+				});
+			}
+		}
+
+		// ranges at changing positions all over the file, the time only depends on the range size
+		for (size_t rangeSize : { 4096, 1024 * 1024 })
+		{
+			MappedFile encryptedFile(inputPath);
+			EncryptedFileReader reader(encryptedFile, fileCryptoKey, baseIVec, 65536, 0, 0);
+			std::vector<byte> range(rangeSize);
+			unsigned long long rangeOffset = 0;
+			RunBenchmark("read-range", sizeParameter + " blockSize=65536 range=" + std::to_string(rangeSize), rangeSize, [&]
+			{
+				reader.ReadRange(rangeOffset, rangeSize, range.data());
+				rangeOffset = (rangeOffset + 7919 * 4096 + 123) % (fileSize - rangeSize);
+			});
+
+			// the same few ranges again and again, after the first round they come from the cache
+			BlockCache blockCache(16 * 1024 * 1024);
+			EncryptedFileReader cachedReader(encryptedFile, fileCryptoKey, baseIVec, 65536, 0, 0, &blockCache);
+			size_t hotRangeNo = 0;
+			RunBenchmark("read-range-cached", sizeParameter + " blockSize=65536 range=" + std::to_string(rangeSize), rangeSize, [&]
+			{
+				cachedReader.ReadRange((hotRangeNo++ % 8) * (fileSize / 8), rangeSize, range.data());
+			});
+		}
+
+		std::remove(inputPath.c_str());
+		std::remove(outputPath.c_str());
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	nameFilter = argc > 1 ? argv[1] : "";
+	std::cout.rdbuf(nullptr);
+
+	try
+	{
+		std::filesystem::path directory = std::filesystem::temp_directory_path() / "bc-file-decryptor-benchmark";
+		std::filesystem::create_directories(directory);
+
+		BenchmarkBase64();
+		BenchmarkPBKDF2();
+		BenchmarkHeaderParse(directory);
+		BenchmarkRSA();
+		BenchmarkBlockIVec();
+		BenchmarkAESBlocks();
+		BenchmarkFileIO(directory);
+
+		std::filesystem::remove_all(directory);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
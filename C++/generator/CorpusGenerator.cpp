@@ -0,0 +1,402 @@
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../TypeDefs.h"
+#include "../Base64Helper.h"
+#include "../BlockIVGenerator.h"
+#include "../HashHelper.h"
+#include "../ThreadPool.h"
+#include "aes.h"
+#include "modes.h"
+#include "pwdbased.h"
+#include "rsa.h"
+#include "sha.h"
+
+// writes a reproducible corpus of encrypted files for performance tests: a .bckey file for a
+// generated account and any number of bc01 files encrypted for it, in exactly the layout the
+// decryptor reads; the same options and seed always result in the same files
+
+namespace fs = std::filesystem;
+
+struct GeneratorOptions
+{
+	std::string outputDirectory;
+	unsigned long long fileCount = 1;
+	unsigned long long minFileSize = 1024 * 1024;
+	unsigned long long maxFileSize = 1024 * 1024;
+	bool isLogDistribution = false;
+	unsigned int blockSize = 4096;
+	bool isPadded = true;
+	unsigned int fileKeyCount = 1;
+	unsigned int kdfIterations = 10000;
+	unsigned int rsaBits = 4096;
+	std::string password = "password";
+	unsigned long long seed = 0;
+	unsigned int threadCount = ThreadPool::GetDefaultThreadCount();
+};
+
+// the account of the corpus, everything a file needs to be encrypted for it
+struct GeneratedAccount
+{
+	CryptoPP::RSA::PublicKey publicKey;
+	std::string userId;
+};
+
+// the helpers report their progress on std::cout, which is silenced while
+// generating, the progress of the generator goes to a separate stream
+static std::ostream report(std::cout.rdbuf());
+
+// AES in counter mode keyed with the seed and the number of a stream is used as
+// random number generator, so every file gets its own reproducible random data
+using SeededRandom = CryptoPP::CTR_Mode<CryptoPP::AES>::Encryption;
+
+static void SeedRandom(SeededRandom& rng, unsigned long long seed, unsigned long long streamNo)
+{
+	byte key[32] = { 0 };
+	byte iv[CryptoPP::AES::BLOCKSIZE] = { 0 };
+	for (size_t i = 0; i < 8; ++i)
+	{
+		key[i] = static_cast<byte>(seed >> (8 * i));
+		key[8 + i] = static_cast<byte>(streamNo >> (8 * i));
+	}
+	rng.SetKeyWithIV(key, sizeof(key), iv, sizeof(iv));
+}
+
+static std::vector<byte> RandomBytes(SeededRandom& rng, size_t count)
+{
+	std::vector<byte> bytes(count);
+	rng.GenerateBlock(bytes.data(), bytes.size());
+	return bytes;
+}
+
+static std::string ToBase64(const std::vector<byte>& data)
+{
+	std::string encoded;
+	Base64Helper::Encode(data, encoded);
+	return encoded;
+}
+
+static std::string ToHex(const std::vector<byte>& data)
+{
+	std::ostringstream hex;
+	for (byte value : data)
+	{
+		hex << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(value);
+	}
+	return hex.str();
+}
+
+static unsigned long long ParseNumber(const std::string& value, const std::string& option)
+{
+	unsigned long long number = 0;
+	try { number = std::stoull(value); }
+	catch (...) { throw std::runtime_error("Could not convert value of option '" + option + "' to integer"); }
+	return number;
+}
+
+static void PrintUsage()
+{
+	report << "Usage: bc-corpus-generator.out [options] [output directory]" << std::endl
+		<< "Options:" << std::endl
+		<< "  --files [count]            number of encrypted files (default: 1)" << std::endl
+		<< "  --min-size [bytes]         smallest plaintext size of a file (default: 1048576)" << std::endl
+		<< "  --max-size [bytes]         largest plaintext size of a file (default: --min-size)" << std::endl
+		<< "  --distribution [name]      distribution of the file sizes, 'uniform' or 'log' (default: uniform)" << std::endl
+		<< "  --block-size [bytes]       block size in the file headers, a multiple of 16 (default: 4096)" << std::endl
+		<< "  --cipher-padding [mode]    'pkcs7' pads the data and stores the padding length in the header," << std::endl
+		<< "                             '0' leaves it unpadded (sizes are rounded up to 16 bytes, default: pkcs7)" << std::endl
+		<< "  --file-keys [count]        number of entries in 'encryptedFileKeys' of each file (default: 1)" << std::endl
+		<< "  --kdf-iterations [count]   PBKDF2 iterations of the .bckey file (default: 10000)" << std::endl
+		<< "  --rsa-bits [bits]          size of the RSA key of the account (default: 4096)" << std::endl
+		<< "  --password [pwd]           password of the account (default: password)" << std::endl
+		<< "  --seed [number]            seed of all random data (default: 0)" << std::endl
+		<< "  --threads [count]          number of threads used to write files (default: number of cores)" << std::endl;
+}
+
+// returns false if the output directory is missing, invalid options result in an exception
+static bool ParseOptions(int argc, char *argv[], GeneratorOptions& options)
+{
+	bool isMaxSizeSet = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg(argv[i]);
+		if (arg.compare(0, 2, "--") != 0)
+		{
+			options.outputDirectory = arg;
+			continue;
+		}
+
+		// all options expect a value
+		if (i + 1 >= argc)
+		{
+			throw std::runtime_error("Missing value for option '" + arg + "'");
+		}
+		std::string value(argv[++i]);
+
+		if (arg == "--files") { options.fileCount = ParseNumber(value, arg); }
+		else if (arg == "--min-size") { options.minFileSize = ParseNumber(value, arg); }
+		else if (arg == "--max-size") { options.maxFileSize = ParseNumber(value, arg); isMaxSizeSet = true; }
+		else if (arg == "--distribution" && (value == "uniform" || value == "log")) { options.isLogDistribution = value == "log"; }
+		else if (arg == "--block-size") { options.blockSize = static_cast<unsigned int>(ParseNumber(value, arg)); }
+		else if (arg == "--cipher-padding" && (value == "pkcs7" || value == "0")) { options.isPadded = value == "pkcs7"; }
+		else if (arg == "--file-keys") { options.fileKeyCount = static_cast<unsigned int>(ParseNumber(value, arg)); }
+		else if (arg == "--kdf-iterations") { options.kdfIterations = static_cast<unsigned int>(ParseNumber(value, arg)); }
+		else if (arg == "--rsa-bits") { options.rsaBits = static_cast<unsigned int>(ParseNumber(value, arg)); }
+		else if (arg == "--password") { options.password = value; }
+		else if (arg == "--seed") { options.seed = ParseNumber(value, arg); }
+		else if (arg == "--threads") { options.threadCount = static_cast<unsigned int>(ParseNumber(value, arg)); }
+		else
+		{
+			throw std::runtime_error("Unknown option '" + arg + "' or invalid value '" + value + "'");
+		}
+	}
+
+	if (!isMaxSizeSet)
+	{
+		options.maxFileSize = options.minFileSize;
+	}
+	if (options.blockSize == 0 || options.blockSize % CryptoPP::AES::BLOCKSIZE != 0 || options.fileKeyCount == 0
+		|| options.kdfIterations == 0 || options.threadCount == 0 || options.password.empty()
+		|| options.maxFileSize < options.minFileSize || (options.isLogDistribution && options.minFileSize == 0))
+	{
+		throw std::runtime_error("Invalid combination of options, see the usage for the allowed values");
+	}
+
+	return options.outputDirectory.length() > 0;
+}
+
+// creates the RSA key of the account and writes the .bckey file with the private key
+// encrypted like DecryptDataPBKDF2 expects it: IVec, HMAC-SHA-256 and the AES ciphertext
+static GeneratedAccount WriteKeyFile(const GeneratorOptions& options, const std::string& keyfilePath)
+{
+	SeededRandom rng;
+	SeedRandom(rng, options.seed, 0);
+
+	CryptoPP::RSA::PrivateKey privateKey;
+	privateKey.Initialize(rng, options.rsaBits, 65537);
+	GeneratedAccount account;
+	account.publicKey.AssignFrom(privateKey);
+	account.userId = ToHex(RandomBytes(rng, 16));
+
+	// the plaintext of the private key is its DER encoding in base 64
+	std::string privateKeyDER;
+	CryptoPP::StringSink privateKeySink(privateKeyDER);
+	privateKey.DEREncodePrivateKey(privateKeySink);
+	std::string privateKeyPlain = ToBase64(std::vector<byte>(privateKeyDER.begin(), privateKeyDER.end()));
+
+	// two AES-256 keys are derived from the password, one for AES and one for the HMAC
+	std::vector<byte> salt = RandomBytes(rng, 32);
+	std::vector<byte> hashBytes(64);
+	CryptoPP::PKCS5_PBKDF2_HMAC<CryptoPP::SHA512> pbkdf2;
+	pbkdf2.DeriveKey(hashBytes.data(), hashBytes.size(), 0, reinterpret_cast<const byte *>(options.password.data()), options.password.size(), salt.data(), salt.size(), options.kdfIterations);
+	auto cryptoKey = std::vector<byte>(hashBytes.begin(), hashBytes.begin() + 32);
+	auto hmacKey = std::vector<byte>(hashBytes.begin() + 32, hashBytes.end());
+
+	std::vector<byte> IVec = RandomBytes(rng, CryptoPP::AES::BLOCKSIZE);
+	CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption aesEncryptor(cryptoKey.data(), cryptoKey.size(), IVec.data());
+	std::string privateKeyCipher;
+	CryptoPP::StringSource(privateKeyPlain, true, new CryptoPP::StreamTransformationFilter(aesEncryptor, new CryptoPP::StringSink(privateKeyCipher)));
+	std::vector<byte> privateKeyBytes(privateKeyCipher.begin(), privateKeyCipher.end());
+
+	std::vector<byte> hmac;
+	HashHelper::ComputeSHA256HMAC(privateKeyBytes, hmacKey, hmac, true);
+
+	std::vector<byte> encryptedPrivateKey(IVec);
+	encryptedPrivateKey.insert(encryptedPrivateKey.end(), hmac.begin(), hmac.end());
+	encryptedPrivateKey.insert(encryptedPrivateKey.end(), privateKeyBytes.begin(), privateKeyBytes.end());
+
+	std::ofstream keyFile(keyfilePath, std::ios::binary);
+	keyFile << R"({"users":[{"id":")" << account.userId
+		<< R"(","privateKey":")" << ToBase64(encryptedPrivateKey)
+		<< R"(","salt":")" << ToBase64(salt)
+		<< R"(","kdfIterations":)" << options.kdfIterations
+		<< R"(,"passwordEncryption":"PBKDF2-SHA512"}]})";
+	if (!keyFile.good())
+	{
+		throw std::runtime_error("Key file (" + keyfilePath + ") could not be written");
+	}
+
+	return account;
+}
+
+static unsigned long long GetFileSize(const GeneratorOptions& options, SeededRandom& rng)
+{
+	unsigned long long random = 0;
+	rng.GenerateBlock(reinterpret_cast<byte *>(&random), sizeof(random));
+
+	unsigned long long size = options.minFileSize;
+	if (options.maxFileSize > options.minFileSize)
+	{
+		if (options.isLogDistribution)
+		{
+			double position = static_cast<double>(random >> 11) / static_cast<double>(1ULL << 53);
+			double logSize = std::log(static_cast<double>(options.minFileSize)) + position * std::log(static_cast<double>(options.maxFileSize) / options.minFileSize);
+			size = std::min(options.maxFileSize, static_cast<unsigned long long>(std::exp(logSize)));
+		}
+		else
+		{
+			size = options.minFileSize + random % (options.maxFileSize - options.minFileSize + 1);
+		}
+	}
+
+	// unpadded data has to fill the AES blocks completely
+	if (!options.isPadded)
+	{
+		size = (size + CryptoPP::AES::BLOCKSIZE - 1) / CryptoPP::AES::BLOCKSIZE * CryptoPP::AES::BLOCKSIZE;
+	}
+	return size;
+}
+
+// writes a bc01 file with random content: the raw header (version and lengths), the core
+// header (JSON) padded to a multiple of the AES block size and the data, whose blocks are
+// encrypted in CBC mode, each one with its own IVec
+static void WriteEncryptedFile(const GeneratorOptions& options, const GeneratedAccount& account, unsigned long long fileNo, const std::string& filePath)
+{
+	SeededRandom rng;
+	SeedRandom(rng, options.seed, fileNo + 1);
+
+	unsigned long long plainSize = GetFileSize(options, rng);
+	unsigned int paddingLen = options.isPadded ? CryptoPP::AES::BLOCKSIZE - plainSize % CryptoPP::AES::BLOCKSIZE : 0;
+
+	// the first 32 bytes of the file key are not needed for the decryption
+	std::vector<byte> fileKey = RandomBytes(rng, 64);
+	std::vector<byte> fileCryptoKey(fileKey.begin() + 32, fileKey.end());
+	std::vector<byte> baseIVec = RandomBytes(rng, CryptoPP::AES::BLOCKSIZE);
+
+	CryptoPP::RSAES_OAEP_SHA_Encryptor rsaEncryptor(account.publicKey);
+	std::vector<byte> encryptedFileKey(rsaEncryptor.CiphertextLength(fileKey.size()));
+	std::ostringstream coreHeader;
+	coreHeader << R"({"cipher":{"algorithm":"AES","mode":"CBC","padding":"PKCS7","keySize":256,"blockSize":)" << options.blockSize
+		<< R"(,"iv":")" << ToBase64(baseIVec) << R"("},"encryptedFileKeys":[)";
+	for (unsigned int keyNo = 0; keyNo < options.fileKeyCount; ++keyNo)
+	{
+		// all entries are encrypted for the account, the decryptor uses the one with the id of the account user
+		rsaEncryptor.Encrypt(rng, fileKey.data(), fileKey.size(), encryptedFileKey.data());
+		coreHeader << (keyNo > 0 ? "," : "") << R"({"type":"user","id":")" << account.userId
+			<< R"(","value":")" << ToBase64(encryptedFileKey) << R"("})";
+	}
+	coreHeader << "]}";
+
+	std::string coreHeaderStr = coreHeader.str();
+	unsigned int coreLen = static_cast<unsigned int>(coreHeaderStr.size());
+	unsigned int corePaddingLen = (CryptoPP::AES::BLOCKSIZE - coreLen % CryptoPP::AES::BLOCKSIZE) % CryptoPP::AES::BLOCKSIZE;
+
+	byte rawHeader[48] = { 'b', 'c', '0', '1' };
+	unsigned int lengths[] = { coreLen, corePaddingLen, paddingLen };
+	for (size_t i = 0; i < 3; ++i)
+	{
+		for (size_t j = 0; j < 4; ++j)
+		{
+			rawHeader[4 + 4 * i + j] = static_cast<byte>(lengths[i] >> (8 * j));
+		}
+	}
+
+	std::ofstream file(filePath, std::ios::binary);
+	file.write(reinterpret_cast<const char *>(rawHeader), sizeof(rawHeader));
+	file.write(coreHeaderStr.data(), coreLen);
+	file << std::string(corePaddingLen, ' ');
+
+	// the data is generated and encrypted in chunks of whole blocks, so the memory
+	// usage doesn't depend on the file size; the key schedule is computed once
+	BlockIVGenerator blockIVGenerator(baseIVec, fileCryptoKey);
+	CryptoPP::CBC_Mode<CryptoPP::AES>::Encryption aesEncryptor;
+	byte blockIVec[BlockIVGenerator::MaxIVecSize];
+	blockIVGenerator.ComputeBlockIVec(0, blockIVec);
+	aesEncryptor.SetKeyWithIV(fileCryptoKey.data(), fileCryptoKey.size(), blockIVec, CryptoPP::AES::BLOCKSIZE);
+
+	unsigned long long cipherSize = plainSize + paddingLen;
+	size_t blocksPerChunk = std::max<size_t>(1, (1024 * 1024) / options.blockSize);
+	std::vector<byte> chunk(blocksPerChunk * options.blockSize);
+	unsigned long long blockNo = 0;
+	for (unsigned long long pos = 0; pos < cipherSize; pos += chunk.size())
+	{
+		size_t chunkSize = static_cast<size_t>(std::min<unsigned long long>(chunk.size(), cipherSize - pos));
+		size_t plainChunkSize = static_cast<size_t>(std::min<unsigned long long>(chunkSize, plainSize - std::min(pos, plainSize)));
+		rng.GenerateBlock(chunk.data(), plainChunkSize);
+
+		// PKCS7 padding: the value of each padding byte is the number of padding bytes
+		std::fill(chunk.begin() + plainChunkSize, chunk.begin() + chunkSize, static_cast<byte>(paddingLen));
+
+		for (size_t blockPos = 0; blockPos < chunkSize; blockPos += options.blockSize, ++blockNo)
+		{
+			size_t blockLen = std::min<size_t>(options.blockSize, chunkSize - blockPos);
+			blockIVGenerator.ComputeBlockIVec(blockNo, blockIVec);
+			aesEncryptor.Resynchronize(blockIVec, CryptoPP::AES::BLOCKSIZE);
+			aesEncryptor.ProcessData(chunk.data() + blockPos, chunk.data() + blockPos, blockLen);
+		}
+		file.write(reinterpret_cast<const char *>(chunk.data()), chunkSize);
+	}
+
+	if (!file.good())
+	{
+		throw std::runtime_error("Encrypted file (" + filePath + ") could not be written");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout.rdbuf(nullptr);
+
+	try
+	{
+		GeneratorOptions options;
+		if (!ParseOptions(argc, argv, options))
+		{
+			PrintUsage();
+			return 0;
+		}
+
+		fs::path outputDirectory(options.outputDirectory);
+		fs::create_directories(outputDirectory / "files");
+
+		report << "Generating account (" << options.rsaBits << " bit RSA key)" << std::endl;
+		std::string keyfilePath = (outputDirectory / "corpus.bckey").string();
+		GeneratedAccount account = WriteKeyFile(options, keyfilePath);
+
+		// at most 1000 files per directory, so even huge corpora stay usable
+		std::vector<std::string> filePaths(options.fileCount);
+		for (unsigned long long fileNo = 0; fileNo < options.fileCount; ++fileNo)
+		{
+			std::ostringstream directoryName, fileName;
+			directoryName << std::setw(6) << std::setfill('0') << fileNo / 1000;
+			fileName << "file-" << std::setw(9) << std::setfill('0') << fileNo << ".bin.bc";
+			filePaths[fileNo] = (outputDirectory / "files" / directoryName.str() / fileName.str()).string();
+			if (fileNo % 1000 == 0)
+			{
+				fs::create_directories(outputDirectory / "files" / directoryName.str());
+			}
+		}
+
+		report << "Generating " << options.fileCount << " encrypted files" << std::endl;
+		ThreadPool threadPool(options.threadCount);
+		threadPool.ParallelFor(filePaths.size(), [&](size_t fileNo)
+		{
+			WriteEncryptedFile(options, account, fileNo, filePaths[fileNo]);
+		});
+
+		// the manifest can be passed to the decryptor with --manifest
+		std::string manifestPath = (outputDirectory / "manifest.txt").string();
+		std::ofstream manifest(manifestPath);
+		for (const auto& filePath : filePaths)
+		{
+			manifest << filePath << "\n";
+		}
+
+		report << "Corpus written to '" << options.outputDirectory << "', key file: '" << keyfilePath << "', password: '"
+			<< options.password << "', manifest: '" << manifestPath << "'" << std::endl;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -1,86 +1,358 @@
-#include <fstream>
-#include <iostream>	
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include "Base64Helper.h"
 #include "PBKDF2Helper.h"
 #include "HashHelper.h"
 #include "AccountData.h"
+#include "AsyncFileDecryptor.h"
+#include "BatchDecryptor.h"
+#include "BufferPool.h"
 #include "FileData.h"
+#include "FileCollector.h"
+#include "FileKeyUnwrapper.h"
+#include "HeaderIndex.h"
+#include "Log.h"
+#include "MappedFile.h"
+#include "OutputFile.h"
+#include "ProgressReporter.h"
 #include "AESHelper.h"
 #include "RSAHelper.h"
+#include "RSAPrivateKey.h"
+#include "ProgramOptions.h"
+#include "RunStatistics.h"
 
-int main(int argc, char *argv[])
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// decrypts a single encrypted file whose file key was already unwrapped, files which
+// aren't mapped are decrypted by [asyncFileDecryptor]
+static void DecryptEncryptedFile(const EncryptedFileEntry& entry, UnwrappedFile& unwrappedFile, const ProgramOptions& options, bool createOutputDirectory, AsyncFileDecryptor *asyncFileDecryptor)
 {
-	if (argc < 4)
+	if (unwrappedFile.error)
 	{
-		std::cout << "Usage: bc-file-decryptor.exe "
-			<< "[path to .bckey file] "
-			<< "[path to encrypted file] "
-			<< "[pwd] "
-			<< "[path for output (optional)] "
-			<< std::endl;
-		return 0;
+		std::rethrow_exception(unwrappedFile.error);
 	}
+	FileData& fileData = *unwrappedFile.fileData;
+	const std::vector<byte>& fileCryptoKey = unwrappedFile.fileCryptoKey;
 
-	// for the sake of keeping this program short just catch
-	// all exceptions in one place and show the error before exiting
+	// =============================================
+	// AES decryption of encrypted file
+	// =============================================
+
+	// the decrypted data of a single file can be streamed to the standard output instead,
+	// e.g. into a pipe; the chunks are decrypted by all threads and written in order
+	size_t headerLen = fileData.GetHeaderLen();
+	unsigned long long encryptedFileSize = unwrappedFile.encryptedFileSize;
+	size_t encryptedDataLen = static_cast<size_t>(encryptedFileSize > headerLen ? encryptedFileSize - headerLen : 0);
+	if (entry.outputFilePath == ProgramOptions::StandardOutputPath)
+	{
+		ProgressReporter::Get().StartFile(encryptedDataLen);
+		if (options.ioMode == "mmap")
+		{
+			AESHelper::DecryptFile(*unwrappedFile.encryptedFile, fileCryptoKey, fileData.GetBaseIVec(), fileData.GetBlockSize(), fileData.GetHeaderLen(), fileData.GetCipherPadding(), std::cout, options.threadCount);
+		}
+		else
+		{
+			AESHelper::DecryptFile(entry.encryptedFilePath, fileCryptoKey, fileData.GetBaseIVec(), fileData.GetBlockSize(), fileData.GetHeaderLen(), fileData.GetCipherPadding(), std::cout, options.threadCount);
+		}
+
+		StageTimer timer(Stage::Write);
+		if (!std::cout.flush().good())
+		{
+			throw std::runtime_error("Decrypted data could not be written to the standard output");
+		}
+		LOG_INFO("Successfully decrypted file '" << fileData.GetEncryptedFilePath() << "', output: standard output");
+		return;
+	}
+
+	// the output paths are only derived here, one file after the other, so two
+	// files can't end up with the same output path if their names collide
+	fileData.SetOutputFilepath(entry.outputFilePath);
+
+	// batch runs recreate the directory structure of the encrypted files
+	std::string outputDirectory = std::filesystem::path(fileData.GetOutputFilepath()).parent_path().string();
+	if (createOutputDirectory && outputDirectory.length() > 0)
+	{
+		std::filesystem::create_directories(outputDirectory);
+	}
+
+	// the decrypted data is at most as long as the encrypted file data, so the output
+	// file is created with that size up front and the blocks are decrypted straight
+	// into it; the padding of the last block is cut off after the decryption; without
+	// mapping, the files are read and written through buffers with many requests in flight
+	ProgressReporter::Get().StartFile(encryptedDataLen);
 	try
 	{
-		std::cout << "Decryption process started" << std::endl;
+		if (asyncFileDecryptor != nullptr)
+		{
+			asyncFileDecryptor->Decrypt(entry.encryptedFilePath, fileCryptoKey, fileData.GetBaseIVec(), fileData.GetBlockSize(), fileData.GetHeaderLen(), fileData.GetCipherPadding(), fileData.GetOutputFilepath());
+		}
+		else
+		{
+			std::unique_ptr<OutputFile> outputFile;
+			{
+				StageTimer timer(Stage::Write);
+				outputFile.reset(new OutputFile(fileData.GetOutputFilepath(), encryptedDataLen));
+			}
+			AESHelper::DecryptFile(*unwrappedFile.encryptedFile, fileCryptoKey, fileData.GetBaseIVec(), fileData.GetBlockSize(), fileData.GetHeaderLen(), fileData.GetCipherPadding(), *outputFile, options.threadCount);
+		}
+	}
+	catch (const std::exception&)
+	{
+		// don't leave a partially decrypted file behind
+		std::remove(fileData.GetOutputFilepath().c_str());
+		throw;
+	}
+
+	LOG_INFO("Successfully decrypted file '" << fileData.GetEncryptedFilePath() << "', output: '" << fileData.GetOutputFilepath() << "'");
+}
+
+// reads the headers of the encrypted files of the run (no keys needed) and writes them to an index
+static void BuildIndex(const ProgramOptions& options)
+{
+	std::vector<EncryptedFileEntry> encryptedFiles;
+	if (options.manifestPath.length() > 0)
+	{
+		FileCollector::CollectManifest(options.manifestPath, "", encryptedFiles);
+	}
+	else
+	{
+		FileCollector::CollectPath(options.encryptedFilePath, "", encryptedFiles);
+	}
+
+	LOG_INFO("Indexing headers of " << encryptedFiles.size() << " files");
+	HeaderIndex headerIndex;
+	headerIndex.Build(encryptedFiles, options.encryptedFilePath, options.threadCount);
+	headerIndex.Write(options.buildIndexPath);
+	LOG_INFO("Indexed " << headerIndex.GetEntries().size() << " of " << encryptedFiles.size() << " files, index: '" << options.buildIndexPath << "'");
+}
+
+// lists the files of an index without opening any of them
+static void ListIndex(const std::string& indexPath)
+{
+	HeaderIndex headerIndex;
+	headerIndex.Load(indexPath);
+
+	unsigned long long totalPlaintextSize = 0;
+	for (const auto& entry : headerIndex.GetEntries())
+	{
+		std::string keyIds;
+		for (const auto& fileKey : entry.fileKeys)
+		{
+			keyIds += (keyIds.empty() ? "" : ",") + fileKey.id;
+		}
+		std::ostringstream line;
+		line << std::setw(16) << entry.maxPlaintextSize << std::setw(10) << entry.blockSize << "  " << entry.encryptedFilePath << "  [" << keyIds << "]" << '\n';
+		Log::Get().WriteOutput(line.str());
+		totalPlaintextSize += entry.maxPlaintextSize;
+	}
+	Log::Get().WriteOutput(std::to_string(headerIndex.GetEntries().size()) + " files, " + std::to_string(totalPlaintextSize) + " bytes of plaintext at most\n");
+}
+
+// without an explicit mode, a progress bar is only drawn on a terminal which shows info messages,
+// i.e. the standard error output if the standard output carries the decrypted data
+static ProgressMode GetProgressMode(const ProgramOptions& options)
+{
+	if (options.progressMode == "bar")
+	{
+		return ProgressMode::Bar;
+	}
+	if (options.progressMode == "json")
+	{
+		return ProgressMode::JSON;
+	}
+	FILE *logStream = Log::Get().IsUsingStandardError() ? stderr : stdout;
+#ifdef _WIN32
+	bool isTerminal = _isatty(_fileno(logStream)) != 0;
+#else
+	bool isTerminal = isatty(fileno(logStream)) != 0;
+#endif
+	return options.progressMode == "auto" && isTerminal && Log::IsEnabled(LogLevel::Info) ? ProgressMode::Bar : ProgressMode::Off;
+}
 
-		// ============================================
-		// AES decryption of private key in .bckey file
-		// =============================================
+// decrypts the private key and with it all encrypted files of the run
+static void DecryptFiles(const ProgramOptions& options)
+{
+	LOG_INFO("Decryption process started");
 
-		// collect information about the user account
-		AccountData accountInfo;
-		accountInfo.ParseBCKeyFile(std::string(argv[1]));
-		accountInfo.SetPassword(std::string(argv[3]));
+	// ============================================
+	// AES decryption of private key in .bckey file
+	// =============================================
 
-		// decrypt the private key from the .bckey file
-		std::string decryptedPrivateKey;
+	// collect information about the user account
+	AccountData accountInfo;
+	{
+		StageTimer timer(Stage::KeyfileParse);
+		accountInfo.ParseBCKeyFile(options.keyfilePath);
+		accountInfo.SetPassword(options.password);
+	}
+
+	// decrypt the private key from the .bckey file
+	std::string decryptedPrivateKey;
+	{
+		StageTimer timer(Stage::PBKDF2);
 		AESHelper::DecryptDataPBKDF2(accountInfo.GetEncryptedPrivateKey(), accountInfo.GetPassword(), accountInfo.GetPBKDF2Salt(), accountInfo.GetPBKDF2Iterations(), decryptedPrivateKey);
+	}
+
+	// load and validate the private RSA key once, it is used for the file keys of all files
+	std::unique_ptr<RSAPrivateKey> privateKey;
+	{
+		StageTimer timer(Stage::RSAKeyLoad);
+		privateKey.reset(new RSAPrivateKey(decryptedPrivateKey, options.rsaValidationLevel));
+	}
+
+
+	// =============================================
+	// decryption of the encrypted file(s)
+	// =============================================
+
+	// a manifest, an index or a directory turns this into a batch run, which decrypts
+	// every file with the private key from above and continues if a single file fails
+	HeaderIndex headerIndex;
+	std::vector<EncryptedFileEntry> encryptedFiles;
+	bool isBatch = options.manifestPath.length() > 0 || options.indexPath.length() > 0 || std::filesystem::is_directory(options.encryptedFilePath);
+	if (options.indexPath.length() > 0)
+	{
+		headerIndex.Load(options.indexPath);
+		FileCollector::CollectIndex(headerIndex, options.outputFilePath, encryptedFiles);
+	}
+	else if (options.manifestPath.length() > 0)
+	{
+		FileCollector::CollectManifest(options.manifestPath, options.outputFilePath, encryptedFiles);
+	}
+	else
+	{
+		FileCollector::CollectPath(options.encryptedFilePath, options.outputFilePath, encryptedFiles);
+	}
+	if (isBatch && options.outputFilePath == ProgramOptions::StandardOutputPath)
+	{
+		throw std::runtime_error("Only a single file can be decrypted to the standard output");
+	}
 
+	ProgressReporter::Get().SetFileCount(encryptedFiles.size());
+	ProgressReporter::Get().Start(GetProgressMode(options));
 
-		// =============================================
-		// RSA decryption of file information (header)
-		// =============================================
+	// the headers of the next files are parsed and their file keys are unwrapped
+	// with the private key in the background, while the current file is decrypted;
+	// the headers are read the same way as the file bodies
+	FileKeyUnwrapper fileKeyUnwrapper(
+		encryptedFiles, *privateKey, accountInfo.GetUserId(), options.threadCount, 4 * static_cast<size_t>(options.threadCount),
+		options.ioMode == "mmap", options.isDirectIO);
 
-		// collect information about the file to be decrypted
-		FileData fileData;
-		auto outputFilepath = argc > 4 ? std::string(argv[4]) : "";
-		fileData.ParseHeader(std::string(argv[2]), outputFilepath);
+	// the mapped files of a batch run are split into ranges of blocks, which all threads
+	// work on at once, so a big file doesn't keep the threads from the small ones
+	size_t failedFiles = 0;
+	if (isBatch && options.ioMode == "mmap")
+	{
+		BatchDecryptor batchDecryptor(options.threadCount, 4 * static_cast<size_t>(options.threadCount));
+		for (const auto& encryptedFile : encryptedFiles)
+		{
+			UnwrappedFile unwrappedFile = fileKeyUnwrapper.Next();
+			batchDecryptor.Add(encryptedFile, unwrappedFile, true);
+		}
+		failedFiles = batchDecryptor.Finish();
+	}
+	else
+	{
+		// without mapping, the threads and the I/O buffers are set up once for all files
+		std::unique_ptr<AsyncFileDecryptor> asyncFileDecryptor;
+		if (options.ioMode != "mmap" && options.outputFilePath != ProgramOptions::StandardOutputPath)
+		{
+			IOBackend ioBackend = options.ioMode == "uring" ? IOBackend::IOUring : IOBackend::PRead;
+			asyncFileDecryptor.reset(new AsyncFileDecryptor(ioBackend, options.isDirectIO, options.threadCount));
+		}
 
-		// decrypt the file key (from file header) used for decryption of file data
-		std::vector<byte> decryptedFileKey;
-		RSAHelper::DecryptData(fileData.GetEncryptedFileKey(), decryptedPrivateKey, decryptedFileKey);
-		
-		auto fileCryptoKey = std::vector<byte>(decryptedFileKey.begin() + 32, decryptedFileKey.begin() + 64);
+		for (const auto& encryptedFile : encryptedFiles)
+		{
+			try
+			{
+				UnwrappedFile unwrappedFile = fileKeyUnwrapper.Next();
+				DecryptEncryptedFile(encryptedFile, unwrappedFile, options, isBatch, asyncFileDecryptor.get());
+				RunStatistics::Get().AddFile(true);
+				ProgressReporter::Get().FinishFile();
+			}
+			catch (const std::exception& e)
+			{
+				RunStatistics::Get().AddFile(false);
+				ProgressReporter::Get().FinishFile();
+				if (!isBatch)
+				{
+					throw;
+				}
+				LOG_ERROR("Decryption of file '" << encryptedFile.encryptedFilePath << "' failed: " << e.what());
+				++failedFiles;
+			}
+		}
+	}
 
-		// =============================================
-		// AES decryption of encrypted file
-		// =============================================
+	ProgressReporter::Get().Finish();
+	if (isBatch)
+	{
+		LOG_INFO("Decrypted " << encryptedFiles.size() - failedFiles << " of " << encryptedFiles.size() << " files"
+			<< (failedFiles > 0 ? ", see above for the errors" : ""));
+	}
+}
 
-		// decrypt the file data ...
-		std::vector<byte> decryptedFileBytes;
-		AESHelper::DecryptFile(fileData.GetEncryptedFilePath(), fileCryptoKey, fileData.GetBaseIVec(), fileData.GetBlockSize(), fileData.GetHeaderLen(), fileData.GetCipherPadding(), decryptedFileBytes);
+int main(int argc, char *argv[])
+{
+	// for the sake of keeping this program short just catch
+	// all exceptions in one place and show the error before exiting
+	try
+	{
+		ProgramOptions options;
+		if (!options.Parse(argc, argv))
+		{
+			ProgramOptions::PrintUsage();
+			return 0;
+		}
 
-		std::ofstream ofs(fileData.GetOutputFilepath(), std::ios::binary);
-		if (!ofs.good())
+		Log::SetLevel(options.logLevel);
+		if (options.outputFilePath == ProgramOptions::StandardOutputPath)
+		{
+			Log::Get().UseStandardError();
+#ifdef _WIN32
+			_setmode(_fileno(stdout), _O_BINARY);
+#endif
+		}
+		RunStatistics::Get().SetThreadCount(options.threadCount);
+		BufferPool::Get().SetHugePages(options.useHugePages);
+		if (options.statsPath.length() > 0)
 		{
-			std::string errorMsg("Can't create encrypted file at location '" + fileData.GetOutputFilepath() + "' (make sure you have the necessary file system rights to write to this location or specify another path)");
-			throw std::runtime_error(errorMsg.c_str());
+			RunStatistics::Get().StartReport(options.statsPath, options.statsInterval);
 		}
-		
-		// ... and write it to disk
-		ofs.write((char *)decryptedFileBytes.data(), decryptedFileBytes.size());
 
-		std::cout << "Successfully decrypted file '" << fileData.GetEncryptedFilePath() << "', output: '" << fileData.GetOutputFilepath() << "'" << std::endl;
+		if (options.listIndexPath.length() > 0)
+		{
+			ListIndex(options.listIndexPath);
+		}
+		else if (options.buildIndexPath.length() > 0)
+		{
+			BuildIndex(options);
+		}
+		else
+		{
+			DecryptFiles(options);
+		}
 	}
 	catch (const std::exception& e)
 	{
-		std::cerr << e.what() << std::endl;
+		LOG_ERROR(e.what());
 	}
-	
+
+	// the progress and the statistics are shown even if the run failed
+	ProgressReporter::Get().Finish();
+	RunStatistics::Get().FinishReport();
+	Log::Get().Flush();
+
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../TypeDefs.h"
+#include "../AccountData.h"
+#include "../AESHelper.h"
+#include "../BlockCache.h"
+#include "../EncryptedFileReader.h"
+#include "../FileCollector.h"
+#include "../FileData.h"
+#include "../FileKeyUnwrapper.h"
+#include "../MappedFile.h"
+#include "../RSAPrivateKey.h"
+
+// behavior checks of the parts of the decryptor which the program itself doesn't call: the byte
+// ranges of EncryptedFileReader, without and with a BlockCache shared by all files, are compared
+// with the plaintext AESHelper::DecryptFile produces for the files of corpora written by the
+// corpus generator, and the keys, the memory limit and the statistics of BlockCache are checked
+// on their own; the arguments are the directories of the corpora (see the test target of the
+// Makefile), the password of their accounts can be given with --password; every failed check
+// is reported, the exit code is 1 if any failed
+
+// the helpers report their progress on std::cout, which is silenced while checking,
+// the results are written to a separate stream on the original buffer
+static std::ostream report(std::cout.rdbuf());
+static unsigned long long passedChecks = 0;
+static unsigned long long failedChecks = 0;
+
+static void Check(bool condition, const std::string& description)
+{
+	if (condition)
+	{
+		++passedChecks;
+		return;
+	}
+	++failedChecks;
+	report << "FAILED: " << description << std::endl;
+}
+
+// an encrypted file of a corpus with its unwrapped key and the plaintext of the whole file
+struct CorpusFile
+{
+	std::unique_ptr<MappedFile> encryptedFile;
+	std::unique_ptr<FileData> fileData;
+	std::vector<byte> fileCryptoKey;
+	std::string plaintext;
+};
+
+// decrypts the private key of the corpus account and with it every file of the manifest,
+// the same way the program does it
+static std::vector<CorpusFile> LoadCorpus(const std::filesystem::path& directory, const std::string& password)
+{
+	AccountData account;
+	account.ParseBCKeyFile((directory / "corpus.bckey").string());
+	account.SetPassword(password);
+	std::string decryptedPrivateKey;
+	AESHelper::DecryptDataPBKDF2(account.GetEncryptedPrivateKey(), account.GetPassword(), account.GetPBKDF2Salt(), account.GetPBKDF2Iterations(), decryptedPrivateKey);
+	RSAPrivateKey privateKey(decryptedPrivateKey);
+
+	std::vector<EncryptedFileEntry> entries;
+	FileCollector::CollectManifest((directory / "manifest.txt").string(), "", entries);
+	FileKeyUnwrapper fileKeyUnwrapper(entries, privateKey, account.GetUserId(), 1, 1);
+	std::vector<CorpusFile> files(entries.size());
+	for (auto& file : files)
+	{
+		UnwrappedFile unwrappedFile = fileKeyUnwrapper.Next();
+		if (unwrappedFile.error)
+		{
+			std::rethrow_exception(unwrappedFile.error);
+		}
+		file.encryptedFile = std::move(unwrappedFile.encryptedFile);
+		file.fileData = std::move(unwrappedFile.fileData);
+		file.fileCryptoKey = unwrappedFile.fileCryptoKey;
+
+		const FileData& fileData = *file.fileData;
+		std::ostringstream plaintext;
+		AESHelper::DecryptFile(*file.encryptedFile, file.fileCryptoKey, fileData.GetBaseIVec(), fileData.GetBlockSize(), fileData.GetHeaderLen(), fileData.GetCipherPadding(), plaintext);
+		file.plaintext = plaintext.str();
+	}
+	return files;
+}
+
+// reads [length] bytes at [offset] and compares them with the plaintext of the whole file, the
+// range is cut at the end of the plaintext and nothing behind the returned length is written
+static void CheckRange(EncryptedFileReader& reader, const CorpusFile& file, unsigned long long offset, size_t length)
+{
+	const unsigned long long plaintextSize = file.plaintext.size();
+	size_t expectedLen = offset < plaintextSize ? static_cast<size_t>(std::min<unsigned long long>(length, plaintextSize - offset)) : 0;
+	const byte untouched = 0xa5;
+	std::vector<byte> output(length + 1, untouched);
+	size_t readLen = reader.ReadRange(offset, length, output.data());
+
+	bool isEqual = readLen == expectedLen
+		&& std::equal(output.begin(), output.begin() + readLen, file.plaintext.begin() + static_cast<size_t>(std::min(offset, plaintextSize)),
+			[](byte outputByte, char plaintextByte) { return outputByte == static_cast<byte>(plaintextByte); })
+		&& std::all_of(output.begin() + readLen, output.end(), [untouched](byte outputByte) { return outputByte == untouched; });
+	Check(isEqual, file.encryptedFile->GetFilePath() + ": range of " + std::to_string(length) + " bytes at " + std::to_string(offset)
+		+ " (read " + std::to_string(readLen) + " of " + std::to_string(expectedLen) + " bytes)");
+}
+
+// ranges at the borders of the blocks, in the last block (which holds the padding), at and
+// behind the end of the plaintext, the whole file and random ranges
+static void CheckRanges(const CorpusFile& file, BlockCache *blockCache = nullptr)
+{
+	const FileData& fileData = *file.fileData;
+	EncryptedFileReader reader(*file.encryptedFile, file.fileCryptoKey, fileData.GetBaseIVec(), fileData.GetBlockSize(), fileData.GetHeaderLen(), fileData.GetCipherPadding(), blockCache);
+
+	const unsigned long long plaintextSize = file.plaintext.size();
+	const unsigned long long blockSize = fileData.GetBlockSize();
+	Check(reader.GetPlaintextSize() == plaintextSize, file.encryptedFile->GetFilePath() + ": plaintext size " + std::to_string(reader.GetPlaintextSize())
+		+ " instead of " + std::to_string(plaintextSize));
+
+	CheckRange(reader, file, 0, static_cast<size_t>(plaintextSize));
+	CheckRange(reader, file, 0, static_cast<size_t>(plaintextSize + blockSize));
+
+	// across every block border (the first ones of big files only), ending right in front of
+	// it, starting at it and covering whole blocks from it
+	for (unsigned long long borderPos = blockSize; borderPos < plaintextSize + blockSize && borderPos <= 64 * blockSize; borderPos += blockSize)
+	{
+		for (unsigned long long distance : { 1ULL, 15ULL, 16ULL, 17ULL, blockSize / 2 })
+		{
+			if (distance <= borderPos)
+			{
+				CheckRange(reader, file, borderPos - distance, static_cast<size_t>(2 * distance));
+				CheckRange(reader, file, borderPos - distance, static_cast<size_t>(distance));
+			}
+			CheckRange(reader, file, borderPos, static_cast<size_t>(distance));
+		}
+		CheckRange(reader, file, borderPos, static_cast<size_t>(2 * blockSize));
+		CheckRange(reader, file, borderPos - blockSize, static_cast<size_t>(blockSize));
+	}
+
+	// the last block ends with the PKCS7 padding, ranges ending inside it, right at the end
+	// of the plaintext and beyond it are cut to the plaintext
+	unsigned long long lastBlockPos = plaintextSize > 0 ? (plaintextSize - 1) / blockSize * blockSize : 0;
+	for (unsigned long long offset : { lastBlockPos, lastBlockPos + 1, plaintextSize > 16 ? plaintextSize - 16 : 0ULL, plaintextSize > 0 ? plaintextSize - 1 : 0ULL })
+	{
+		for (unsigned long long length : { 1ULL, 15ULL, 16ULL, 17ULL, blockSize, 3 * blockSize })
+		{
+			CheckRange(reader, file, offset, static_cast<size_t>(length));
+		}
+	}
+	CheckRange(reader, file, plaintextSize, 1);
+	CheckRange(reader, file, plaintextSize, static_cast<size_t>(blockSize));
+	CheckRange(reader, file, plaintextSize + 1, 1);
+	CheckRange(reader, file, plaintextSize + blockSize, 16);
+	CheckRange(reader, file, 0, 0);
+
+	std::mt19937_64 random(plaintextSize);
+	for (unsigned int rangeNo = 0; rangeNo < 200; ++rangeNo)
+	{
+		unsigned long long offset = random() % (plaintextSize + 32);
+		size_t length = static_cast<size_t>(random() % (4 * blockSize + 1));
+		CheckRange(reader, file, offset, length);
+	}
+}
+
+static BlockCache::Block MakeBlock(size_t size, byte value)
+{
+	return std::make_shared<const std::vector<byte>>(size, value);
+}
+
+static bool IsBlock(const BlockCache::Block& block, size_t size, byte value)
+{
+	return block != nullptr && block->size() == size && std::all_of(block->begin(), block->end(), [value](byte blockByte) { return blockByte == value; });
+}
+
+// a block costs its size and 128 bytes of bookkeeping in the cache
+static const size_t BlockLen = 1000;
+static const size_t BlockCost = BlockLen + 128;
+
+// the blocks of a file are only found with the id of the same path, size and modification time
+static void CheckBlockCacheKeys()
+{
+	BlockCache cache(100 * BlockCost, 4);
+	unsigned long long firstFileId = cache.GetFileId("first.bc", 5000);
+	unsigned long long secondFileId = cache.GetFileId("second.bc", 5000);
+	Check(firstFileId != secondFileId, "block cache: files with different paths have different ids");
+	Check(cache.GetFileId("first.bc", 5000) == firstFileId, "block cache: same file gets the same id again");
+	Check(cache.GetFileId("first.bc", 6000) != firstFileId, "block cache: file with a new size gets a new id");
+
+	cache.Insert(firstFileId, 0, MakeBlock(BlockLen, 1));
+	Check(cache.Find(secondFileId, 0) == nullptr, "block cache: block 0 of a second file is not served from the entry of the first file");
+	cache.Insert(secondFileId, 0, MakeBlock(BlockLen, 2));
+	Check(IsBlock(cache.Find(firstFileId, 0), BlockLen, 1), "block cache: block 0 of the first file is found with its id");
+	Check(IsBlock(cache.Find(secondFileId, 0), BlockLen, 2), "block cache: block 0 of the second file is found with its id");
+	Check(cache.Find(firstFileId, 1) == nullptr, "block cache: block which wasn't added is not found");
+
+	// a file which is written again in place keeps its path and size
+	std::filesystem::path filePath = std::filesystem::temp_directory_path() / "bc-file-decryptor-tests.bc";
+	std::ofstream(filePath, std::ios::binary) << std::string(5000, 'x');
+	unsigned long long oldFileId = cache.GetFileId(filePath.string(), 5000);
+	std::filesystem::last_write_time(filePath, std::filesystem::last_write_time(filePath) + std::chrono::seconds(10));
+	Check(cache.GetFileId(filePath.string(), 5000) != oldFileId, "block cache: file with a new modification time gets a new id");
+	std::filesystem::remove(filePath);
+}
+
+// the least recently used block of all shards is evicted, the used bytes never exceed the
+// limit and the hits, misses and evictions of all shards are counted
+static void CheckBlockCacheLimit()
+{
+	const unsigned long long cachedBlockCount = 10;
+	BlockCache cache(cachedBlockCount * BlockCost, 4);
+	unsigned long long fileIds[] = { cache.GetFileId("first.bc", 50000), cache.GetFileId("second.bc", 50000) };
+
+	// 100 blocks of two files in all shards, only the last 10 of them fit
+	bool isWithinLimit = true;
+	for (unsigned long long blockNo = 0; blockNo < 50; ++blockNo)
+	{
+		for (unsigned long long fileId : fileIds)
+		{
+			cache.Insert(fileId, blockNo, MakeBlock(BlockLen, static_cast<byte>(blockNo)));
+			isWithinLimit = isWithinLimit && cache.GetStatistics().usedBytes <= cachedBlockCount * BlockCost;
+		}
+	}
+	Check(isWithinLimit, "block cache: used bytes stay within the limit while blocks are added");
+	BlockCacheStatistics statistics = cache.GetStatistics();
+	Check(statistics.usedBytes == cachedBlockCount * BlockCost, "block cache: used bytes of a full cache are " + std::to_string(statistics.usedBytes));
+	Check(statistics.evictions == 100 - cachedBlockCount, "block cache: " + std::to_string(statistics.evictions) + " evictions instead of 90");
+
+	unsigned long long foundCount = 0;
+	bool isLastFound = true;
+	for (unsigned long long blockNo = 0; blockNo < 50; ++blockNo)
+	{
+		for (unsigned long long fileId : fileIds)
+		{
+			bool isFound = IsBlock(cache.Find(fileId, blockNo), BlockLen, static_cast<byte>(blockNo));
+			foundCount += isFound ? 1 : 0;
+			isLastFound = isLastFound && isFound == (blockNo >= 50 - cachedBlockCount / 2);
+		}
+	}
+	Check(isLastFound && foundCount == cachedBlockCount, "block cache: only the most recently added blocks are kept");
+	statistics = cache.GetStatistics();
+	Check(statistics.hits == cachedBlockCount && statistics.misses == 100 - cachedBlockCount, "block cache: "
+		+ std::to_string(statistics.hits) + " hits and " + std::to_string(statistics.misses) + " misses instead of 10 and 90");
+
+	// a block which was used recently survives, whichever shard holds the oldest block
+	cache.Find(fileIds[0], 45);
+	cache.Insert(fileIds[0], 50, MakeBlock(BlockLen, 50));
+	Check(cache.Find(fileIds[0], 45) != nullptr, "block cache: recently used block is not evicted");
+	Check(cache.Find(fileIds[1], 45) == nullptr, "block cache: least recently used block is evicted");
+
+	// adding a block again replaces it (the room for it is made first, which may evict
+	// another block), a block bigger than the limit is not added at all
+	unsigned long long evictionCount = cache.GetStatistics().evictions;
+	cache.Insert(fileIds[0], 50, MakeBlock(BlockLen, 51));
+	Check(IsBlock(cache.Find(fileIds[0], 50), BlockLen, 51), "block cache: block added again replaces the old one");
+	statistics = cache.GetStatistics();
+	Check(statistics.usedBytes == (cachedBlockCount - (statistics.evictions - evictionCount)) * BlockCost, "block cache: replaced block is only counted once");
+	evictionCount = statistics.evictions;
+	cache.Insert(fileIds[0], 100, MakeBlock(cachedBlockCount * BlockCost, 0));
+	Check(cache.Find(fileIds[0], 100) == nullptr && cache.GetStatistics().evictions == evictionCount, "block cache: block bigger than the limit is not added");
+}
+
+// several threads add and look up blocks while another one watches the used bytes
+static void CheckBlockCacheThreads()
+{
+	const unsigned long long cachedBlockCount = 64;
+	const unsigned int threadCount = 4;
+	const unsigned long long blocksPerThread = 2000;
+	BlockCache cache(cachedBlockCount * BlockCost);
+
+	std::atomic<bool> isDone{ false };
+	std::atomic<bool> isWithinLimit{ true };
+	std::thread watcher([&]() {
+		while (!isDone)
+		{
+			if (cache.GetStatistics().usedBytes > cachedBlockCount * BlockCost)
+			{
+				isWithinLimit = false;
+			}
+		}
+	});
+
+	std::atomic<unsigned long long> foundCount{ 0 };
+	std::atomic<bool> isFoundCorrect{ true };
+	std::vector<std::thread> threads;
+	for (unsigned int threadNo = 0; threadNo < threadCount; ++threadNo)
+	{
+		threads.emplace_back([&, threadNo]() {
+			unsigned long long fileId = cache.GetFileId("file-" + std::to_string(threadNo) + ".bc", 1 << 30);
+			for (unsigned long long blockNo = 0; blockNo < blocksPerThread; ++blockNo)
+			{
+				cache.Insert(fileId, blockNo, MakeBlock(BlockLen, static_cast<byte>(threadNo)));
+				BlockCache::Block block = cache.Find(fileId, blockNo / 2);
+				if (block != nullptr)
+				{
+					++foundCount;
+					isFoundCorrect = isFoundCorrect && IsBlock(block, BlockLen, static_cast<byte>(threadNo));
+				}
+			}
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	isDone = true;
+	watcher.join();
+
+	BlockCacheStatistics statistics = cache.GetStatistics();
+	unsigned long long insertCount = threadCount * blocksPerThread;
+	Check(isWithinLimit, "block cache: used bytes never exceed the limit while threads add blocks");
+	Check(isFoundCorrect, "block cache: threads only find blocks of their own files");
+	Check(statistics.hits == foundCount && statistics.hits + statistics.misses == insertCount, "block cache: hits and misses of all threads are counted");
+	Check(statistics.usedBytes % BlockCost == 0 && statistics.evictions == insertCount - statistics.usedBytes / BlockCost,
+		"block cache: every block which isn't cached anymore is counted as eviction");
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout.rdbuf(nullptr);
+
+	std::string password = "password";
+	std::vector<std::string> corpusDirectories;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg(argv[i]);
+		if (arg == "--password" && i + 1 < argc)
+		{
+			password = argv[++i];
+		}
+		else
+		{
+			corpusDirectories.push_back(arg);
+		}
+	}
+	if (corpusDirectories.empty())
+	{
+		report << "Usage: bc-file-decryptor-tests.out [--password pwd] [corpus directory]..." << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		CheckBlockCacheKeys();
+		CheckBlockCacheLimit();
+		CheckBlockCacheThreads();
+
+		for (const auto& corpusDirectory : corpusDirectories)
+		{
+			std::vector<CorpusFile> files = LoadCorpus(corpusDirectory, password);
+			for (const auto& file : files)
+			{
+				CheckRanges(file);
+			}
+
+			// all files share a cache which holds only a few blocks and one which holds
+			// all of them, a block of one file must never be read for another one
+			for (size_t cacheSize : { 64 * 1024, 256 * 1024 * 1024 })
+			{
+				BlockCache blockCache(cacheSize);
+				for (const auto& file : files)
+				{
+					CheckRanges(file, &blockCache);
+				}
+				Check(blockCache.GetStatistics().usedBytes <= cacheSize, "block cache: used bytes of corpus '" + corpusDirectory + "' stay within the limit");
+			}
+			report << "Checked " << files.size() << " files of corpus '" << corpusDirectory << "'" << std::endl;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	report << passedChecks << " checks passed, " << failedChecks << " failed" << std::endl;
+	return failedChecks > 0 ? 1 : 0;
+}